@@ -0,0 +1,82 @@
+/*
+ * CacheSet.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+
+#ifndef CACHESET_HPP_INCLUDED
+#define CACHESET_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace HttpUtils
+{
+
+/**
+ * Caches of one thread for the route tables it used last, such as
+ * NegativeCache or ChainCache. Each cache belongs to one generation of a
+ * route table, so a thread which alternates between a few routers, or
+ * routes nested requests through another router, keeps the entries of
+ * each of them. When all caches are taken the least recently used one is
+ * reset for the new generation.
+ */
+template <class Cache, std::size_t N = 4>
+class CacheSet
+{
+public:
+
+    CacheSet()
+        : caches_()
+        , lastUse_()
+        , clock_(0)
+    {
+    }
+
+    /** @return cache of the generation or 0 */
+    Cache * find(std::uint64_t generation)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            if (caches_[i].generation() == generation)
+            {
+                lastUse_[i] = ++clock_;
+                return &caches_[i];
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Cache of the generation, which replaces the least recently used
+     * cache if there is none.
+     *
+     * @param  generation  generation of the route table, not 0
+     * @param  capacity    number of entries of a new cache
+     */
+    Cache & acquire(std::uint64_t generation, std::size_t capacity)
+    {
+        if (Cache *cache = find(generation))
+            return *cache;
+        std::size_t victim = 0;
+        for (std::size_t i = 1; i < N; ++i)
+        {
+            if (lastUse_[i] < lastUse_[victim])
+                victim = i;
+        }
+        caches_[victim].reset(generation, capacity);
+        lastUse_[victim] = ++clock_;
+        return caches_[victim];
+    }
+
+private:
+
+    Cache caches_[N];
+    std::uint64_t lastUse_[N];
+    std::uint64_t clock_;
+};
+
+} // namespace HttpUtils
+
+#endif /* CACHESET_HPP_INCLUDED */
@@ -0,0 +1,102 @@
+/*
+ * ChainCache.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+#include "ChainCache.hpp"
+#include "RouteTable.hpp"
+#include <cstring>
+
+namespace HttpUtils
+{
+
+void ChainCache::Chain::clear()
+{
+    routes.clear();
+    captureEnds.clear();
+    captures.clear();
+    position = 0;
+}
+
+ChainCache::ChainCache()
+    : slots_()
+    , generation_(0)
+{
+}
+
+std::uint64_t ChainCache::hash(const std::string &method, const char *first, const char *last)
+{
+    return RouteTable::hash(first, last) ^ (RouteTable::hash(method.data(), method.data() + method.size()) * 31);
+}
+
+void ChainCache::reset(std::uint64_t generation, std::size_t capacity)
+{
+    std::size_t size = capacity != 0 ? WAYS : 0;
+    while (size < capacity)
+        size *= 2;
+
+    generation_ = generation;
+    slots_.resize(size);
+    for (std::vector<Slot>::iterator it = slots_.begin(), et = slots_.end(); it != et; ++it)
+        it->used = false;
+}
+
+bool ChainCache::matches(const Slot &slot, std::uint64_t hash, const std::string &method,
+                         const char *first, const char *last) const
+{
+    const std::size_t length = last - first;
+    return slot.used && slot.hash == hash && slot.method == method &&
+           slot.path.size() == length && std::memcmp(slot.path.data(), first, length) == 0;
+}
+
+const ChainCache::Chain * ChainCache::find(const std::string &method, const char *first, const char *last) const
+{
+    if (slots_.empty())
+        return 0;
+
+    const std::uint64_t h = hash(method, first, last);
+    for (std::size_t i = set(h), n = i + WAYS; i < n; ++i)
+    {
+        if (matches(slots_[i], h, method, first, last))
+            return &slots_[i].chain;
+    }
+    return 0;
+}
+
+ChainCache::Chain * ChainCache::insert(const std::string &method, const char *first, const char *last)
+{
+    if (slots_.empty())
+        return 0;
+
+    const std::uint64_t h = hash(method, first, last);
+    const std::size_t base = set(h);
+    // The entry of the pair, an unused slot of the set, otherwise one chosen by the upper bits of the hash.
+    std::size_t victim = base + (h >> 62) % WAYS;
+    bool found = false;
+    for (std::size_t i = base, n = i + WAYS; i < n && !found; ++i)
+    {
+        if (matches(slots_[i], h, method, first, last))
+        {
+            victim = i;
+            found = true;
+        }
+    }
+    for (std::size_t i = base, n = i + WAYS; i < n && !found; ++i)
+    {
+        if (!slots_[i].used)
+        {
+            victim = i;
+            found = true;
+        }
+    }
+    Slot &slot = slots_[victim];
+    slot.hash = h;
+    slot.method = method;
+    slot.path.assign(first, last);
+    slot.chain.clear();
+    slot.used = true;
+    return &slot.chain;
+}
+
+} // namespace HttpUtils
@@ -0,0 +1,100 @@
+/*
+ * ChainCache.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+
+#ifndef CHAINCACHE_HPP_INCLUDED
+#define CHAINCACHE_HPP_INCLUDED
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace HttpUtils
+{
+
+/**
+ * Bounded map of recently seen (method, path) pairs to the routes which
+ * matched them, in the order the handlers ran, with the capture offsets of
+ * every match. HttpRouter keeps a CacheSet of them per thread.
+ *
+ * Like NegativeCache the cache is 4-way set associative and all entries
+ * belong to one generation of a route table, see reset(). Entries keep
+ * their memory when they are replaced, so a warm cache does not allocate.
+ */
+class ChainCache
+{
+public:
+
+    /**
+     * Routes of a request which matched so far. The routes depend only on
+     * the method, the path and the route table, the handlers only decide
+     * how many of them run.
+     */
+    struct Chain
+    {
+        /** Index of each matched route */
+        std::vector<std::uint32_t> routes;
+        /** End of the captures of each matched route in captures */
+        std::vector<std::uint32_t> captureEnds;
+        std::vector<std::size_t> captures;
+        /** Position in the candidate routes after the last matched route */
+        std::size_t position;
+
+        void clear();
+    };
+
+    ChainCache();
+
+    std::uint64_t generation() const { return generation_; }
+
+    std::size_t capacity() const { return slots_.size(); }
+
+    /**
+     * Drop all entries and use the cache for another generation.
+     *
+     * @param  generation  generation of the route table
+     * @param  capacity    number of entries, rounded up to a power of two of at least WAYS, 0 disables the cache
+     */
+    void reset(std::uint64_t generation, std::size_t capacity);
+
+    /** @return chain of the pair or 0 */
+    const Chain * find(const std::string &method, const char *first, const char *last) const;
+
+    /**
+     * Add an entry for the pair or replace the existing one.
+     *
+     * @return empty chain of the entry to be filled by the caller, 0 if the cache is disabled
+     */
+    Chain * insert(const std::string &method, const char *first, const char *last);
+
+    static const std::size_t WAYS = 4;
+
+private:
+
+    struct Slot
+    {
+        std::uint64_t hash;
+        std::string method;
+        std::string path;
+        Chain chain;
+        bool used;
+    };
+
+    static std::uint64_t hash(const std::string &method, const char *first, const char *last);
+
+    /** First slot of the set of the hash */
+    std::size_t set(std::uint64_t hash) const { return (hash * WAYS) & (slots_.size() - 1); }
+
+    bool matches(const Slot &slot, std::uint64_t hash, const std::string &method, const char *first, const char *last) const;
+
+    std::vector<Slot> slots_;
+    std::uint64_t generation_;
+};
+
+} // namespace HttpUtils
+
+#endif /* CHAINCACHE_HPP_INCLUDED */
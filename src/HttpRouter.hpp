@@ -10,11 +10,94 @@
 
 #include <functional>
 #include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <initializer_list>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include <atomic>
 #include "PathToRegexp.hpp"
+#include "PathMatcher.hpp"
+#include "RouteTable.hpp"
+#include "NegativeCache.hpp"
+#include "CacheSet.hpp"
+#include "ChainCache.hpp"
+#include "UriUtils.hpp"
+#include "MonotonicBuffer.hpp"
+#include "ParamTraits.hpp"
 
 namespace HttpUtils
 {
 
+namespace detail
+{
+
+/**
+ * Allocator which aligns arrays to cache lines, so that a scan over an
+ * array touches no more lines than necessary.
+ */
+template <class T>
+class CacheAlignedAllocator
+{
+public:
+    typedef T value_type;
+
+    static const std::size_t CACHE_LINE_SIZE = 64;
+
+    CacheAlignedAllocator() {}
+
+    template <class U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}
+
+    T * allocate(std::size_t n)
+    {
+        // The address of the block is stored in front of the aligned array.
+        char *block = static_cast<char *>(::operator new(n * sizeof(T) + CACHE_LINE_SIZE + sizeof(void *)));
+        const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block + sizeof(void *));
+        char *result = block + sizeof(void *) + (CACHE_LINE_SIZE - address % CACHE_LINE_SIZE) % CACHE_LINE_SIZE;
+        std::memcpy(result - sizeof(void *), &block, sizeof(void *));
+        return reinterpret_cast<T *>(result);
+    }
+
+    void deallocate(T *p, std::size_t)
+    {
+        void *block;
+        std::memcpy(&block, reinterpret_cast<char *>(p) - sizeof(void *), sizeof(void *));
+        ::operator delete(block);
+    }
+};
+
+template <class T, class U>
+bool operator==(const CacheAlignedAllocator<T> &, const CacheAlignedAllocator<U> &)
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const CacheAlignedAllocator<T> &, const CacheAlignedAllocator<U> &)
+{
+    return false;
+}
+
+/** Start loading the cache line of address, where supported by the compiler */
+inline void prefetch(const void *address)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+} // namespace detail
+
+/**
+ * Specializations provide `getMethod(request)` and `getUriPath(request)`.
+ * The URI path may include the query string, it is not used for routing
+ * and is available through Context::queryParams() and Context::query().
+ */
 template <class Request>
 struct RequestTraits
 {
@@ -42,36 +125,239 @@ public:
 
     class Context;
     typedef std::function<void(RequestParamType, ResponseParamType, Context &)> Handler;
+
+    /** Bits of the method sets returned by allowedMethods() */
+    enum MethodBits
+    {
+        METHOD_GET = 1 << 0,
+        METHOD_HEAD = 1 << 1,
+        METHOD_POST = 1 << 2,
+        METHOD_PUT = 1 << 3,
+        METHOD_DELETE = 1 << 4,
+        METHOD_CONNECT = 1 << 5,
+        METHOD_OPTIONS = 1 << 6,
+        METHOD_TRACE = 1 << 7,
+        METHOD_PATCH = 1 << 8
+    };
+
+    /** Any other method, the route compares the method name */
+    static const std::uint32_t METHOD_OTHER = 1u << 31;
+
+    static const std::uint32_t ALL_METHODS = 0xffffffffu;
 private:
-    struct Matcher
+
+    /** Number of methods with a bit of their own, GET to PATCH */
+    static const std::size_t METHOD_COUNT = 9;
+
+    /**
+     * Engine kind of case-insensitive static routes, which are matched by
+     * the lookup in the static route table alone
+     */
+    static const std::uint8_t STATIC_MATCH = RC_BACKTRACKING + 1;
+
+    /**
+     * Data of a route which is only needed once the route matched.
+     */
+    struct Route
     {
         std::string method;
-        std::regex pathRegex;
+        std::string path;
+        std::vector<PathKey> keys;
+        /** ParamFormat of each key, see Context::param(const std::string &, T &) */
+        std::vector<ParamFormat> formats;
+        /** Handler of the route, the fallback of a route created by route() */
         Handler handler;
+        /** Handlers of a route created by route(), indexed by methodIndex() */
+        std::vector<Handler> methodHandlers;
+        /** Handlers of a route created by route() for other methods */
+        std::vector<std::pair<std::string, Handler> > otherHandlers;
+        /** Index of the routes with the same path and options, see groupMethods_ */
+        std::size_t group;
+        RouteAnalysis analysis;
+        /** The route matches every path, e.g. `*` */
+        bool catchAll;
+        /** The route counts for allowedMethods(), it matches whole paths and is not catch-all */
+        bool endpoint;
+        /** Position of the path among the paths of a multi-path route */
+        std::size_t alternative;
+        /** Number of paths of the route, routes added together are adjacent */
+        std::size_t alternatives;
+    };
 
-        Matcher(const std::string &method, const std::regex &pathRegex, Handler handler)
-            : method(method), pathRegex(pathRegex), handler(handler)
-        {
-        }
+    /** Loader of the values of a route parameter, see param() */
+    struct ParamHook
+    {
+        std::string name;
+        /** Construct the result for the parameter value in the storage */
+        std::function<void(void *, Context &, StringRef)> load;
+        void (*destroy)(void *);
+        /** Type of the result, see typeTag() */
+        const void *type;
+        std::size_t size;
+        std::size_t alignment;
+    };
 
-        Matcher(const std::string &method, std::regex &&pathRegex, Handler &&handler)
-            : method(method), pathRegex(std::move(pathRegex)), handler(std::move(handler))
-        {
-        }
+    template <class T>
+    struct HotArray
+    {
+        typedef std::vector<T, detail::CacheAlignedAllocator<T> > type;
+    };
+
+    /**
+     * Data of all routes which is read for every candidate route, one
+     * contiguous array per field and indexed by route. Most candidates are
+     * rejected by the method mask or the literal prefix without touching
+     * their engine or any other data of the route.
+     */
+    struct RouteLayout
+    {
+        /** Mask of MethodBits accepted by the route */
+        typename HotArray<std::uint32_t>::type methods;
+        /** Last eight bytes of the lowercased literal prefix, see prefixTail() */
+        typename HotArray<std::uint64_t>::type prefixTails;
+        /** Length of the literal prefix every matched path starts with */
+        typename HotArray<std::uint32_t>::type prefixLengths;
+        /** RouteClass of the engine or STATIC_MATCH */
+        typename HotArray<std::uint8_t>::type engineKinds;
+        /** Index into engines_ or, for RC_BACKTRACKING routes, into regexes_ */
+        typename HotArray<std::uint32_t>::type engineIndices;
+    };
+
+    typedef std::vector<Route> RouteList;
 
+    /** Capture offsets of a match, allocated from a request arena */
+    typedef std::vector<std::size_t, MonotonicAllocator<std::size_t> > Captures;
+
+    /**
+     * Lowercased path of a request and the routes which may match it,
+     * see lookupRoutes().
+     */
+    struct Lookup
+    {
+        char *uri;
+        std::size_t uriSize;
+        const char *lowerPath;
+        std::size_t pathSize;
+        bool pathChanged;
+        std::uint64_t hash;
+        const std::vector<std::size_t> *routes;
     };
-    typedef std::vector<Matcher> MatcherList;
+
+    /** Number of requests looked up together by handleRequests() and matchBatch() */
+    static const std::size_t BATCH_SIZE = 16;
 public:
 
-    HttpRouter() : matchers_() { }
-    HttpRouter(const HttpRouter &other) : matchers_(other) { }
-    HttpRouter(HttpRouter &&other) : matchers_(std::move(other)) { }
+    /** Returned by matchBatch() for paths which match no route */
+    static const std::size_t NO_ROUTE = static_cast<std::size_t>(-1);
+
+    HttpRouter()
+        : routes_()
+        , layout_()
+        , engines_()
+        , regexes_()
+        , staticRoutes_()
+        , dynamicRoutes_()
+        , segmentRoutes_()
+        , anyRoutes_()
+        , catchAllRoutes_()
+        , paramHooks_()
+        , groupMethods_()
+        , groupIndices_()
+        , generation_(nextGeneration())
+        , negativeCacheSize_(1024)
+        , chainCacheSize_(0)
+        , maxProgramSize_(0)
+        , maxCaptureSize_(0)
+        , maxPathLength_(std::string::npos)
+        , pathNormalization_(0)
+        , defaultOptions_(PR_END)
+        , uriTooLongHandler_()
+        , rejectRiskyRoutes_(false)
+        , foldCaseOnce_(true)
+    {
+    }
+
+    HttpRouter(const HttpRouter &other)
+        : routes_(other.routes_)
+        , layout_(other.layout_)
+        , engines_(other.engines_)
+        , regexes_(other.regexes_)
+        , staticRoutes_(other.staticRoutes_)
+        , dynamicRoutes_(other.dynamicRoutes_)
+        , segmentRoutes_(other.segmentRoutes_)
+        , anyRoutes_(other.anyRoutes_)
+        , catchAllRoutes_(other.catchAllRoutes_)
+        , paramHooks_(other.paramHooks_)
+        , groupMethods_(other.groupMethods_)
+        , groupIndices_(other.groupIndices_)
+        , generation_(nextGeneration())
+        , negativeCacheSize_(other.negativeCacheSize_)
+        , chainCacheSize_(other.chainCacheSize_)
+        , maxProgramSize_(other.maxProgramSize_)
+        , maxCaptureSize_(other.maxCaptureSize_)
+        , maxPathLength_(other.maxPathLength_)
+        , pathNormalization_(other.pathNormalization_)
+        , defaultOptions_(other.defaultOptions_)
+        , uriTooLongHandler_(other.uriTooLongHandler_)
+        , rejectRiskyRoutes_(other.rejectRiskyRoutes_)
+        , foldCaseOnce_(other.foldCaseOnce_)
+    {
+    }
+
+    HttpRouter(HttpRouter &&other)
+        : routes_(std::move(other.routes_))
+        , layout_(std::move(other.layout_))
+        , engines_(std::move(other.engines_))
+        , regexes_(std::move(other.regexes_))
+        , staticRoutes_(std::move(other.staticRoutes_))
+        , dynamicRoutes_(std::move(other.dynamicRoutes_))
+        , segmentRoutes_(std::move(other.segmentRoutes_))
+        , anyRoutes_(std::move(other.anyRoutes_))
+        , catchAllRoutes_(std::move(other.catchAllRoutes_))
+        , paramHooks_(std::move(other.paramHooks_))
+        , groupMethods_(std::move(other.groupMethods_))
+        , groupIndices_(std::move(other.groupIndices_))
+        , generation_(nextGeneration())
+        , negativeCacheSize_(other.negativeCacheSize_)
+        , chainCacheSize_(other.chainCacheSize_)
+        , maxProgramSize_(other.maxProgramSize_)
+        , maxCaptureSize_(other.maxCaptureSize_)
+        , maxPathLength_(other.maxPathLength_)
+        , pathNormalization_(other.pathNormalization_)
+        , defaultOptions_(other.defaultOptions_)
+        , uriTooLongHandler_(std::move(other.uriTooLongHandler_))
+        , rejectRiskyRoutes_(other.rejectRiskyRoutes_)
+        , foldCaseOnce_(other.foldCaseOnce_)
+    {
+    }
 
     HttpRouter & operator=(const HttpRouter &other)
     {
         if (this != &other)
         {
-            matchers_ = other.matchers_;
+            routes_ = other.routes_;
+            layout_ = other.layout_;
+            engines_ = other.engines_;
+            regexes_ = other.regexes_;
+            staticRoutes_ = other.staticRoutes_;
+            dynamicRoutes_ = other.dynamicRoutes_;
+            segmentRoutes_ = other.segmentRoutes_;
+            anyRoutes_ = other.anyRoutes_;
+            catchAllRoutes_ = other.catchAllRoutes_;
+            paramHooks_ = other.paramHooks_;
+            groupMethods_ = other.groupMethods_;
+            groupIndices_ = other.groupIndices_;
+            generation_ = nextGeneration();
+            negativeCacheSize_ = other.negativeCacheSize_;
+            chainCacheSize_ = other.chainCacheSize_;
+            maxProgramSize_ = other.maxProgramSize_;
+            maxCaptureSize_ = other.maxCaptureSize_;
+            maxPathLength_ = other.maxPathLength_;
+            pathNormalization_ = other.pathNormalization_;
+            defaultOptions_ = other.defaultOptions_;
+            uriTooLongHandler_ = other.uriTooLongHandler_;
+            rejectRiskyRoutes_ = other.rejectRiskyRoutes_;
+            foldCaseOnce_ = other.foldCaseOnce_;
         }
         return *this;
     }
@@ -80,7 +366,29 @@ public:
     {
         if (this != &other)
         {
-            matchers_ = std::move(other.matchers_);
+            routes_ = std::move(other.routes_);
+            layout_ = std::move(other.layout_);
+            engines_ = std::move(other.engines_);
+            regexes_ = std::move(other.regexes_);
+            staticRoutes_ = std::move(other.staticRoutes_);
+            dynamicRoutes_ = std::move(other.dynamicRoutes_);
+            segmentRoutes_ = std::move(other.segmentRoutes_);
+            anyRoutes_ = std::move(other.anyRoutes_);
+            catchAllRoutes_ = std::move(other.catchAllRoutes_);
+            paramHooks_ = std::move(other.paramHooks_);
+            groupMethods_ = std::move(other.groupMethods_);
+            groupIndices_ = std::move(other.groupIndices_);
+            generation_ = nextGeneration();
+            negativeCacheSize_ = other.negativeCacheSize_;
+            chainCacheSize_ = other.chainCacheSize_;
+            maxProgramSize_ = other.maxProgramSize_;
+            maxCaptureSize_ = other.maxCaptureSize_;
+            maxPathLength_ = other.maxPathLength_;
+            pathNormalization_ = other.pathNormalization_;
+            defaultOptions_ = other.defaultOptions_;
+            uriTooLongHandler_ = std::move(other.uriTooLongHandler_);
+            rejectRiskyRoutes_ = other.rejectRiskyRoutes_;
+            foldCaseOnce_ = other.foldCaseOnce_;
         }
         return *this;
     }
@@ -90,72 +398,1882 @@ public:
         friend class HttpRouter;
     public:
 
+        /** Query parameters, allocated from the request arena */
+        typedef std::vector<QueryParam, MonotonicAllocator<QueryParam> > QueryParamList;
+
         void next()
         {
+            // Routes of a cached chain run without matching.
+            if (chainHop_ < cachedHops_)
+            {
+                replayHop();
+                return;
+            }
+            if (resumePending_)
+            {
+                resumePending_ = false;
+                findCandidates();
+                position_ = chainResume_;
+            }
+            // Sized once for the route with the most capture groups.
+            if (scratch_.capacity() < router_.maxCaptureSize_)
+            {
+                scratch_.reserve(router_.maxCaptureSize_);
+                captures_.reserve(router_.maxCaptureSize_);
+            }
+            for (std::size_t index = nextRoute(); index != NO_ROUTE; index = nextRoute())
+            {
+                if (!router_.acceptsRoute(index, methodBit_, method_, lowerPath(), pathSize_))
+                    continue;
+
+                if (router_.matchRoute(index, uriPath_, lowerPath(), pathSize_, scratch_))
+                {
+                    const Route &route = router_.routes_[index];
+                    if (!route.catchAll)
+                        specificMatched_ = true;
+                    else if (!specificMatched_ && onlyCatchAllRoutesLeft())
+                        recordNegative();
+                    matched_ = &route;
+                    if (route.alternatives > 1)
+                        skipAlternatives(index - route.alternative + route.alternatives);
+                    captures_.swap(scratch_);
+                    if (recordChain_)
+                        recordHop(index);
+                    decoded_.assign(captures_.size() / 2, StringRef());
+                    router_.routeHandler(route, methodBit_, method_)(request_, response_, *this);
+                    return;
+                }
+            }
+            if (!specificMatched_)
+                recordNegative();
+            // A mounted router passes requests it does not handle back.
+            if (parent_)
+                parent_->next();
+        }
+
+        std::string match(std::size_t i = 0) const
+        {
+            return rawParam(i).to_string();
+        }
+
+        /**
+         * Raw value of the i-th capture group of the matched route as a view
+         * into the request path. Returns an empty view when the group did
+         * not participate in the match.
+         */
+        StringRef rawParam(std::size_t i) const
+        {
+            if (2 * i + 1 >= captures_.size() || captures_[2 * i] == PathMatcher::npos)
+                return StringRef();
+            return StringRef(uriPath_ + captures_[2 * i], captures_[2 * i + 1] - captures_[2 * i]);
+        }
+
+        /**
+         * Raw value of the named route parameter, see rawParam(size_type).
+         */
+        StringRef rawParam(const std::string &name) const
+        {
+            return rawParam(paramIndex(name));
+        }
+
+        /**
+         * Percent-decoded value of the i-th capture group of the matched route.
+         *
+         * Decoding happens on first access. When there is nothing to decode
+         * a view into the request path is returned, otherwise the decoded
+         * value is stored in a per-request buffer. Views stay valid until
+         * the request is handled.
+         */
+        StringRef param(std::size_t i) const
+        {
+            const StringRef raw = rawParam(i);
+            if (raw.data() == 0)
+                return raw;
+
+            StringRef &decoded = decoded_[i];
+            if (decoded.data() == 0)
+                decoded = decode(raw);
+            return decoded;
+        }
+
+        /**
+         * Percent-decoded value of the named route parameter, see param(size_type).
+         */
+        StringRef param(const std::string &name) const
+        {
+            return param(paramIndex(name));
+        }
+
+        /**
+         * Convert the named route parameter to T without an intermediate
+         * string, see ParamTraits. Values of keys whose pattern only admits
+         * digits, e.g. `:id(\d+)`, are neither decoded nor checked for other
+         * characters.
+         *
+         * @return false if the parameter did not match or is not a valid T
+         */
+        template <class T>
+        bool param(const std::string &name, T &value) const
+        {
+            const std::size_t i = paramIndex(name);
+            const StringRef raw = rawParam(i);
+            if (raw.data() == 0)
+                return false;
+            const ParamFormat format = matched_->formats[i - 1];
+            return ParamTraits<T>::parse(format == PF_DIGITS ? raw : param(i), matched_->keys[i - 1], format, value);
+        }
+
+        /**
+         * Named route parameter converted to T, e.g.
+         * `ctx.param<std::int64_t>("id")`.
+         *
+         * @throw std::logic_error if the parameter did not match or is not a valid T
+         */
+        template <class T>
+        T param(const std::string &name) const
+        {
+            T value = T();
+            if (!param(name, value))
+                throw std::logic_error("Expected \"" + name + "\" to be a valid parameter");
+            return value;
+        }
+
+        /**
+         * Position of the matched path among the paths of a multi-path
+         * route, see HttpRouter::add(const std::string &, It, It, int, Handler).
+         * 0 for routes with a single path.
+         */
+        std::size_t alternative() const
+        {
+            return matched_ ? matched_->alternative : 0;
+        }
 
-            for (; current_ != end_; ++current_)
+        /**
+         * Methods of the routes which match the path of the request, see
+         * HttpRouter::allowedMethods(). Computed on first access, e.g. by a
+         * catch-all route which responds with 405 Method Not Allowed.
+         */
+        std::uint32_t allowedMethods() const
+        {
+            if (!allowedKnown_)
             {
-                if (method_ == current_->method ||
-                    current_->method.empty() ||
-                    current_->method == "*")
+                if (pathSize_ <= router_.maxPathLength_)
                 {
-                    if (std::regex_search(uriPath_, match_, current_->pathRegex))
-                    {
-                        const Matcher &matcher = *current_++;
-                        matcher.handler(request_, response_, *this);
-                        return;
-                    }
+                    const char *path = lowerPath();
+                    Captures captures((MonotonicAllocator<std::size_t>(*arena_)));
+                    allowed_ = router_.allowedMethods(router_.findRoutes(path, pathSize_), uriPath_, path, pathSize_, captures);
                 }
+                allowedKnown_ = true;
+            }
+            return allowed_;
+        }
+
+        /**
+         * Arena of the request. Memory allocated from it stays valid until
+         * the request is handled, then the arena is released as a whole and
+         * reused by later requests of the same thread.
+         */
+        MonotonicBuffer & arena() const
+        {
+            return *arena_;
+        }
+
+        /**
+         * Allocator for containers which do not outlive the request, see arena().
+         */
+        template <class T = char>
+        MonotonicAllocator<T> allocator() const
+        {
+            return MonotonicAllocator<T>(*arena_);
+        }
+
+        /**
+         * Routed path of the request, without the query string. This is the
+         * normalized path when path normalization is enabled.
+         */
+        StringRef path() const
+        {
+            return StringRef(uriPath_, pathSize_);
+        }
+
+        /**
+         * Part of the request path which was consumed by the mount points of
+         * the routers this request was passed to, see mount(). Empty for the
+         * top router. path() is the rest of the path.
+         */
+        StringRef basePath() const
+        {
+            return StringRef(uriPath_ - basePathSize_, basePathSize_);
+        }
+
+        /**
+         * True when path normalization changed the path of the request, e.g.
+         * to redirect to the canonical path().
+         */
+        bool pathChanged() const
+        {
+            return pathChanged_;
+        }
+
+        /**
+         * Segments of the request path (without the query string) split at
+         * `/`, computed on first access. The segment views refer to the raw
+         * path, see splitPath().
+         */
+        const PathSegments & pathSegments() const
+        {
+            if (!segmentsSplit_)
+            {
+                splitPath(uriPath_, uriPath_ + pathSize_, segments_);
+                segmentsSplit_ = true;
+            }
+            return segments_;
+        }
+
+        /**
+         * Raw query string of the request URI, without the leading `?`.
+         */
+        StringRef queryString() const
+        {
+            if (pathSize_ == uriSize_)
+                return StringRef();
+            return StringRef(uriPath_ + pathSize_ + 1, uriSize_ - pathSize_ - 1);
+        }
+
+        /**
+         * Raw key/value pairs of the query string, in order of appearance.
+         * The query string is parsed on first access only.
+         */
+        const QueryParamList & queryParams() const
+        {
+            if (!queryParsed_)
+            {
+                const StringRef qs = queryString();
+                parseQueryString(qs.data(), qs.data() + qs.size(), queryParams_);
+                queryDecoded_.resize(queryParams_.size());
+                queryParsed_ = true;
+            }
+            return queryParams_;
+        }
+
+        /**
+         * Percent-decoded value of the n-th occurrence of key in the query
+         * string, or an empty view with null data when there is none.
+         * Keys and values are decoded lazily, see param().
+         */
+        StringRef query(StringRef key, std::size_t n = 0) const
+        {
+            const QueryParamList &params = queryParams();
+            for (std::size_t i = 0, sz = params.size(); i < sz; ++i)
+            {
+                if (decodeQuery(params[i].key, queryDecoded_[i].key) == key && n-- == 0)
+                    return decodeQuery(params[i].value, queryDecoded_[i].value);
+            }
+            return StringRef();
+        }
+
+        /**
+         * Result of the param hook of name, see HttpRouter::param(), for the
+         * value of the parameter in the matched route. The hook runs on
+         * first access, the result is kept until the request is handled
+         * and shared by all handlers and mounted routers of the request.
+         *
+         * @throw std::logic_error if there is no hook of type T for name
+         *        or the matched route has no such parameter
+         */
+        template <class T>
+        const T & load(const std::string &name)
+        {
+            const ParamHook *hook = router_.findParamHook(name);
+            if (!hook || hook->type != typeTag<T>())
+                throw std::logic_error("Expected a param hook for \"" + name + "\" of the requested type");
+            const StringRef value = param(name);
+            if (value.data() == 0)
+                throw std::logic_error("Expected \"" + name + "\" to be a parameter of the route");
+
+            // Results are kept by the context of the request, mounted routers have contexts of their own.
+            Context *root = this;
+            while (root->parent_)
+                root = root->parent_;
+            for (std::size_t i = 0, n = root->loaded_.size(); i < n; ++i)
+            {
+                const Loaded &loaded = root->loaded_[i];
+                if (loaded.hook == hook && loaded.value == value)
+                    return *static_cast<const T *>(loaded.result);
+            }
+            MonotonicBuffer &arena = *root->arena_;
+            Loaded loaded;
+            loaded.hook = hook;
+            loaded.value = StringRef(copyChars(arena, value.data(), value.size()), value.size());
+            loaded.result = arena.allocate(hook->size, hook->alignment);
+            hook->load(loaded.result, *this, loaded.value);
+            try
+            {
+                root->loaded_.push_back(loaded);
             }
+            catch (...)
+            {
+                hook->destroy(loaded.result);
+                throw;
+            }
+            return *static_cast<const T *>(loaded.result);
         }
 
-        std::smatch::string_type match(std::smatch::size_type i = 0) const
+        ~Context()
         {
-            return match_.str(i);
+            for (std::size_t i = loaded_.size(); i-- > 0;)
+                loaded_[i].hook->destroy(loaded_[i].result);
         }
 
     private:
 
-        Context(RequestParamType request, ResponseParamType response, const MatcherList &matchers)
-            : request_(request)
+        /** Result of a param hook, see load() */
+        struct Loaded
+        {
+            const ParamHook *hook;
+            StringRef value;
+            void *result;
+        };
+
+        /**
+         * Index of the next candidate route in registration order. For the
+         * path of a static route these are the routes found in the static
+         * route table, otherwise the routes with parameters of the bucket
+         * of the first path segment.
+         */
+        std::size_t nextRoute()
+        {
+            const std::vector<std::size_t> &routes = *candidates_;
+            return position_ < routes.size() ? routes[position_++] : NO_ROUTE;
+        }
+
+        /**
+         * Skip the candidates before route index end. The other paths of a
+         * multi-path route are not tried after one of them matched.
+         */
+        void skipAlternatives(std::size_t end)
+        {
+            const std::vector<std::size_t> &routes = *candidates_;
+            while (position_ < routes.size() && routes[position_] < end)
+                ++position_;
+        }
+
+        bool onlyCatchAllRoutesLeft() const
+        {
+            for (std::size_t i = position_, n = candidates_->size(); i < n; ++i)
+            {
+                if (!router_.routes_[(*candidates_)[i]].catchAll)
+                    return false;
+            }
+            return true;
+        }
+
+        /**
+         * Remember that no route other than catch-all routes matches the
+         * method and path of this request.
+         */
+        void recordNegative()
+        {
+            if (negativeKnown_ || router_.negativeCacheSize_ == 0)
+                return;
+            negativeKnown_ = true;
+            // A handler may have added routes in the meantime.
+            if (NegativeCache *cache = threadNegativeCaches().find(router_.generation_))
+                cache->insert(method_, uriPath_, uriPath_ + pathSize_);
+        }
+
+        /** The path converted to lower case, computed once */
+        const char * lowerPath() const
+        {
+            if (!lowerPath_)
+            {
+                char *out = arena_->allocateChars(pathSize_);
+                asciiToLower(uriPath_, uriPath_ + pathSize_, out);
+                lowerPath_ = out;
+            }
+            return lowerPath_;
+        }
+
+        StringRef decode(StringRef raw) const
+        {
+            const char *first = raw.data();
+            const char *last = first + raw.size();
+            if (findURIEscape(first, last) == last)
+                return raw;
+            char *out = arena_->allocateChars(raw.size());
+            return StringRef(out, decodeURIComponent(first, last, out) - out);
+        }
+
+        StringRef decodeQuery(StringRef raw, StringRef &decoded) const
+        {
+            if (decoded.data() == 0)
+                decoded = decode(raw);
+            return decoded;
+        }
+
+        /** Index of the capture group of the named parameter, or npos */
+        std::size_t paramIndex(const std::string &name) const
+        {
+            if (matched_)
+            {
+                for (std::size_t k = 0, n = matched_->keys.size(); k < n; ++k)
+                {
+                    if (matched_->keys[k].name == name)
+                        return k + 1;
+                }
+            }
+            return static_cast<std::size_t>(-1);
+        }
+
+        Context(RequestParamType request, ResponseParamType response, const HttpRouter &router)
+            : Context(request, response, router, RequestTraits<Request>::getUriPath(request))
+        {
+        }
+
+        Context(RequestParamType request, ResponseParamType response, const HttpRouter &router, StringRef uri)
+            : arena_(threadBufferPool())
+            , router_(router)
+            , request_(request)
             , response_(response)
             , method_(RequestTraits<Request>::getMethod(request))
-            , uriPath_(RequestTraits<Request>::getUriPath(request))
-            , current_(std::begin(matchers))
-            , end_(std::end(matchers))
+            , methodBit_(methodBit(method_))
+            , uriPath_(copyChars(*arena_, uri.data(), uri.size()))
+            , uriSize_(uri.size())
+            , pathSize_(pathLength(uriPath_, uriSize_))
+            , parent_(0)
+            , basePathSize_(0)
+            , candidates_(&router.anyRoutes_)
+            , position_(0)
+            , lowerPath_(0)
+            , specificMatched_(false)
+            , negativeKnown_(false)
+            , pathChanged_(false)
+            , captures_(MonotonicAllocator<std::size_t>(*arena_))
+            , scratch_(MonotonicAllocator<std::size_t>(*arena_))
+            , matched_(0)
+            , decoded_(MonotonicAllocator<StringRef>(*arena_))
+            , segmentsSplit_(false)
+            , queryParsed_(false)
+            , queryParams_(MonotonicAllocator<QueryParam>(*arena_))
+            , queryDecoded_(MonotonicAllocator<QueryParam>(*arena_))
+            , allowedKnown_(false)
+            , allowed_(0)
+            , loaded_(MonotonicAllocator<Loaded>(*arena_))
+            , chainRoutes_(MonotonicAllocator<std::uint32_t>(*arena_))
+            , chainCaptureEnds_(MonotonicAllocator<std::uint32_t>(*arena_))
+            , chainCaptures_(MonotonicAllocator<std::size_t>(*arena_))
+            , chainHop_(0)
+            , cachedHops_(0)
+            , chainResume_(0)
+            , resumePending_(false)
+            , recordChain_(false)
+        {
+        }
+
+        /**
+         * Context of a router mounted by mount(). It refers to the part of
+         * the path of the parent after offset, which has already been
+         * normalized, without copying it.
+         */
+        Context(const HttpRouter &router, Context &parent, std::size_t offset)
+            : arena_(threadBufferPool())
+            , router_(router)
+            , request_(parent.request_)
+            , response_(parent.response_)
+            , method_(parent.method_)
+            , methodBit_(parent.methodBit_)
+            , uriPath_(parent.uriPath_ + offset)
+            , uriSize_(parent.uriSize_ - offset)
+            , pathSize_(parent.pathSize_ - offset)
+            , parent_(&parent)
+            , basePathSize_(parent.basePathSize_ + offset)
+            , candidates_(&router.anyRoutes_)
+            , position_(0)
+            , lowerPath_(parent.lowerPath_ ? parent.lowerPath_ + offset : 0)
+            , specificMatched_(false)
+            // The negative cache is only used by the top router.
+            , negativeKnown_(true)
+            , pathChanged_(parent.pathChanged_)
+            , captures_(MonotonicAllocator<std::size_t>(*arena_))
+            , scratch_(MonotonicAllocator<std::size_t>(*arena_))
+            , matched_(0)
+            , decoded_(MonotonicAllocator<StringRef>(*arena_))
+            , segmentsSplit_(false)
+            , queryParsed_(false)
+            , queryParams_(MonotonicAllocator<QueryParam>(*arena_))
+            , queryDecoded_(MonotonicAllocator<QueryParam>(*arena_))
+            , allowedKnown_(false)
+            , allowed_(0)
+            , loaded_(MonotonicAllocator<Loaded>(*arena_))
+            , chainRoutes_(MonotonicAllocator<std::uint32_t>(*arena_))
+            , chainCaptureEnds_(MonotonicAllocator<std::uint32_t>(*arena_))
+            , chainCaptures_(MonotonicAllocator<std::size_t>(*arena_))
+            , chainHop_(0)
+            , cachedHops_(0)
+            , chainResume_(0)
+            , resumePending_(false)
+            , recordChain_(false)
+        {
+        }
+
+        /** Route the remaining path of the request with a mounted router */
+        void descend(const HttpRouter &router)
         {
+            // The match of the mount point ends where the sub-router starts.
+            Context child(router, *this, captures_[1]);
+            child.handle();
         }
 
-        void handle()
+        /**
+         * Route the request. lookup holds the candidate routes when the
+         * request was looked up as part of a batch.
+         */
+        void handle(const Lookup *lookup = 0)
         {
+            // Overlong paths are rejected before any matching.
+            if (pathSize_ > router_.maxPathLength_)
+            {
+                position_ = candidates_->size();
+                negativeKnown_ = true;
+                if (router_.uriTooLongHandler_)
+                    router_.uriTooLongHandler_(request_, response_, *this);
+                return;
+            }
+            // Batched requests were normalized by handleRequests(), mounted
+            // routers see the normalized path of their parent.
+            if (lookup)
+                pathChanged_ = lookup->pathChanged;
+            else if (!parent_)
+                pathChanged_ = router_.normalize(uriPath_, uriSize_, pathSize_);
+            if (router_.chainCacheSize_ != 0 && !parent_)
+            {
+                ChainCache &cache = threadChainCaches().acquire(router_.generation_, router_.chainCacheSize_);
+                recordChain_ = true;
+                if (const ChainCache::Chain *chain = cache.find(method_, uriPath_, uriPath_ + pathSize_))
+                {
+                    loadChain(*chain, lookup);
+                    next();
+                    storeChain();
+                    return;
+                }
+            }
+            if (router_.negativeCacheSize_ != 0 && !negativeKnown_)
+            {
+                // Paths which recently matched nothing go straight to the catch-all routes.
+                NegativeCache &cache = threadNegativeCaches().acquire(router_.generation_, router_.negativeCacheSize_);
+                if (cache.contains(method_, uriPath_, uriPath_ + pathSize_))
+                {
+                    candidates_ = &router_.catchAllRoutes_;
+                    negativeKnown_ = true;
+                    recordChain_ = false;
+                    next();
+                    return;
+                }
+            }
+            if (lookup)
+            {
+                lowerPath_ = lookup->lowerPath;
+                candidates_ = lookup->routes;
+            }
+            else
+            {
+                findCandidates();
+            }
             next();
+            if (recordChain_)
+                storeChain();
+        }
+
+        /** Candidate routes of the path from the static route table or the segment buckets */
+        void findCandidates()
+        {
+            if (router_.staticRoutes_.empty() && router_.segmentRoutes_.empty())
+                return;
+            const char *path = lowerPath();
+            const std::vector<std::size_t> *routes = router_.staticRoutes_.find(path, path + pathSize_);
+            if (!routes)
+            {
+                // Lowercasing keeps the positions of the segments.
+                const PathSegments &segments = pathSegments();
+                const std::size_t first = (pathSize_ != 0 && path[0] == '/') ? 1 : 0;
+                routes = router_.segmentRoutes_.find(path + segments.begin(first), path + segments.end(first));
+            }
+            if (routes)
+                candidates_ = routes;
+        }
+
+        /**
+         * Continue with the routes of a cached chain. The candidate routes
+         * are only looked up if a handler passes the request on after the
+         * last cached route.
+         */
+        void loadChain(const ChainCache::Chain &chain, const Lookup *lookup)
+        {
+            // Copied, a handler may route other requests which replace the entry.
+            chainRoutes_.assign(chain.routes.begin(), chain.routes.end());
+            chainCaptureEnds_.assign(chain.captureEnds.begin(), chain.captureEnds.end());
+            chainCaptures_.assign(chain.captures.begin(), chain.captures.end());
+            cachedHops_ = chainRoutes_.size();
+            chainResume_ = chain.position;
+            negativeKnown_ = true;
+            if (lookup)
+            {
+                lowerPath_ = lookup->lowerPath;
+                candidates_ = lookup->routes;
+                position_ = chainResume_;
+            }
+            else
+            {
+                resumePending_ = true;
+            }
+        }
+
+        /** Run the handler of the next route of a cached chain */
+        void replayHop()
+        {
+            const std::size_t hop = chainHop_++;
+            const Route &route = router_.routes_[chainRoutes_[hop]];
+            if (!route.catchAll)
+                specificMatched_ = true;
+            matched_ = &route;
+            const std::size_t first = hop == 0 ? 0 : chainCaptureEnds_[hop - 1];
+            captures_.assign(chainCaptures_.begin() + first, chainCaptures_.begin() + chainCaptureEnds_[hop]);
+            decoded_.assign(captures_.size() / 2, StringRef());
+            router_.routeHandler(route, methodBit_, method_)(request_, response_, *this);
+        }
+
+        /** Append the matched route and its captures to the chain of the request */
+        void recordHop(std::size_t index)
+        {
+            chainRoutes_.push_back(static_cast<std::uint32_t>(index));
+            chainCaptures_.insert(chainCaptures_.end(), captures_.begin(), captures_.end());
+            chainCaptureEnds_.push_back(static_cast<std::uint32_t>(chainCaptures_.size()));
+            chainHop_ = chainRoutes_.size();
+        }
+
+        /** Cache the chain of the request if routes were matched */
+        void storeChain()
+        {
+            if (chainRoutes_.size() == cachedHops_)
+                return;
+            // A handler may have added routes in the meantime.
+            ChainCache *cache = threadChainCaches().find(router_.generation_);
+            if (!cache)
+                return;
+            ChainCache::Chain *chain = cache->insert(method_, uriPath_, uriPath_ + pathSize_);
+            if (!chain)
+                return;
+            chain->routes.assign(chainRoutes_.begin(), chainRoutes_.end());
+            chain->captureEnds.assign(chainCaptureEnds_.begin(), chainCaptureEnds_.end());
+            chain->captures.assign(chainCaptures_.begin(), chainCaptures_.end());
+            chain->position = position_;
         }
 
+        MonotonicBufferPool::Lease arena_;
+        const HttpRouter &router_;
         RequestValueType request_;
         ResponseValueType response_;
         std::string method_;
-        std::string uriPath_;
-        typename MatcherList::const_iterator current_;
-        typename MatcherList::const_iterator end_;
-        std::smatch match_;
+        std::uint32_t methodBit_;
+        char *uriPath_;
+        std::size_t uriSize_;
+        std::size_t pathSize_;
+        Context *parent_;
+        std::size_t basePathSize_;
+        const std::vector<std::size_t> *candidates_;
+        std::size_t position_;
+        mutable const char *lowerPath_;
+        bool specificMatched_;
+        bool negativeKnown_;
+        bool pathChanged_;
+        Captures captures_;
+        Captures scratch_;
+        const Route *matched_;
+        mutable std::vector<StringRef, MonotonicAllocator<StringRef> > decoded_;
+        mutable bool segmentsSplit_;
+        mutable PathSegments segments_;
+        mutable bool queryParsed_;
+        mutable QueryParamList queryParams_;
+        mutable QueryParamList queryDecoded_;
+        mutable bool allowedKnown_;
+        mutable std::uint32_t allowed_;
+        std::vector<Loaded, MonotonicAllocator<Loaded> > loaded_;
+        /** Matched routes of the request, see ChainCache::Chain */
+        std::vector<std::uint32_t, MonotonicAllocator<std::uint32_t> > chainRoutes_;
+        std::vector<std::uint32_t, MonotonicAllocator<std::uint32_t> > chainCaptureEnds_;
+        Captures chainCaptures_;
+        /** Number of routes of the chain which ran */
+        std::size_t chainHop_;
+        /** Number of routes of the chain loaded from the cache */
+        std::size_t cachedHops_;
+        /** Candidate position after the cached routes */
+        std::size_t chainResume_;
+        bool resumePending_;
+        bool recordChain_;
+    };
+
+    /**
+     * Handle of a route created by route() which dispatches on the method
+     * of the request. The path is parsed and compiled once, the handlers
+     * are kept in a per-method table of the route. The handle refers to
+     * the router by address and must not outlive it.
+     */
+    class RouteHandle
+    {
+        friend class HttpRouter;
+    public:
+
+        RouteHandle & get(Handler handler) { return method("GET", std::move(handler)); }
+
+        RouteHandle & head(Handler handler) { return method("HEAD", std::move(handler)); }
+
+        RouteHandle & post(Handler handler) { return method("POST", std::move(handler)); }
+
+        RouteHandle & put(Handler handler) { return method("PUT", std::move(handler)); }
+
+        RouteHandle & del(Handler handler) { return method("DELETE", std::move(handler)); }
+
+        RouteHandle & patch(Handler handler) { return method("PATCH", std::move(handler)); }
+
+        RouteHandle & options(Handler handler) { return method("OPTIONS", std::move(handler)); }
+
+        /**
+         * Handler for all methods without a handler of their own.
+         */
+        RouteHandle & all(Handler handler) { return method("*", std::move(handler)); }
+
+        /**
+         * Set the handler of method, replacing a previous one. `*` sets
+         * the handler of all methods without a handler of their own.
+         */
+        RouteHandle & method(const std::string &method, Handler handler)
+        {
+            router_->setRouteHandler(index_, method, std::move(handler));
+            return *this;
+        }
+
+        /** Index of the route, see routeAnalysis() */
+        std::size_t index() const
+        {
+            return index_;
+        }
+
+    private:
+
+        RouteHandle(HttpRouter &router, std::size_t index)
+            : router_(&router)
+            , index_(index)
+        {
+        }
+
+        HttpRouter *router_;
+        std::size_t index_;
     };
 
+    /**
+     * Add a route with the default options, see setDefaultOptions(). Every
+     * route is analyzed when it is added, see routeAnalysis() and
+     * setRejectRiskyRoutes().
+     */
     void add(const std::string &method, const std::string &path, Handler handler)
     {
-        std::vector<PathKey> keys;
-        std::regex re = to_regex(pathToRegexp(path, keys));
-        matchers_.emplace_back(method, std::move(re), std::move(handler));
+        add(method, path, defaultOptions_, std::move(handler));
     }
 
-    void handleRequest(RequestParamType request, ResponseParamType response) const
+    /**
+     * Add a route matched with options, a combination of PR_SENSITIVE,
+     * PR_STRICT and PR_END as for pathToRegexp(). Case-sensitive routes are
+     * matched without case folding, strict routes without the optional
+     * trailing slash.
+     */
+    void add(const std::string &method, const std::string &path, int options, Handler handler)
     {
-        Context ctx(request, response, matchers_);
-        ctx.handle();
+        addRoute(methodMask(method), method, path, parsePath(path), options, std::move(handler));
     }
 
-private:
-    MatcherList matchers_;
-};
+    /**
+     * Add a route with several paths, e.g. legacy aliases of a path. Every
+     * path is indexed like a route of its own, but the paths form one
+     * route: its handler runs at most once per request, and
+     * Context::alternative() tells which path matched. Parameters are
+     * looked up by name in the matched path.
+     *
+     * @param  method
+     * @param  first    first path
+     * @param  last     end of the paths
+     * @param  options  combination of PR_SENSITIVE, PR_STRICT and PR_END
+     * @param  handler
+     */
+    template <class It>
+    void add(const std::string &method, It first, It last, int options, Handler handler)
+    {
+        std::vector<std::string> paths;
+        std::vector<std::vector<PathToken> > tokens;
+        std::vector<CompiledRoute> compiled;
+        for (; first != last; ++first)
+        {
+            paths.push_back(*first);
+            tokens.push_back(parsePath(paths.back()));
+            // All paths are compiled first, a rejected path adds none of them.
+            compiled.push_back(compileRoute(paths.back(), tokens.back(), options));
+        }
+        if (paths.empty())
+            throw std::logic_error("Route without paths");
+
+        const std::size_t begin = routes_.size();
+        for (std::size_t i = 0; i < paths.size(); ++i)
+            addRoute(methodMask(method), method, paths[i], tokens[i], options, std::move(compiled[i]), Handler(handler));
+        for (std::size_t i = 0; i < paths.size(); ++i)
+        {
+            routes_[begin + i].alternative = i;
+            routes_[begin + i].alternatives = paths.size();
+        }
+    }
+
+    /** Add a route with several paths and the default options */
+    template <class It>
+    void add(const std::string &method, It first, It last, Handler handler)
+    {
+        add(method, first, last, defaultOptions_, std::move(handler));
+    }
+
+    /** Add a route with several paths, e.g. `router.add("GET", {"/user/:id", "/u/:id"}, show)` */
+    void add(const std::string &method, std::initializer_list<const char *> paths, Handler handler)
+    {
+        add(method, paths.begin(), paths.end(), defaultOptions_, std::move(handler));
+    }
+
+    void add(const std::string &method, std::initializer_list<const char *> paths, int options, Handler handler)
+    {
+        add(method, paths.begin(), paths.end(), options, std::move(handler));
+    }
+
+    /**
+     * Methods of the routes which match path (without a query string),
+     * catch-all routes such as `*` and prefixes added by use() excluded. The result is a combination
+     * of MethodBits. METHOD_OTHER stands for any method that does not have
+     * its own bit. Routes with the same path and options share one method
+     * set, so each distinct path pattern is matched at most once. The path
+     * is normalized like request paths, see setPathNormalization().
+     * Used for OPTIONS requests and for 405 Method Not Allowed responses,
+     * see methodNames().
+     */
+    std::uint32_t allowedMethods(const std::string &path) const
+    {
+        if (path.size() > maxPathLength_)
+            return 0;
+        MonotonicBufferPool::Lease buffer(threadBufferPool());
+        char *uri = copyChars(*buffer, path.data(), path.size());
+        std::size_t uriSize = path.size(), size = path.size();
+        normalize(uri, uriSize, size);
+        char *lowerPath = buffer->allocateChars(size);
+        asciiToLower(uri, uri + size, lowerPath);
+        Captures captures((MonotonicAllocator<std::size_t>(*buffer)));
+        return allowedMethods(findRoutes(lowerPath, size), uri, lowerPath, size, captures);
+    }
+
+    /**
+     * Comma separated names of a set of methods, e.g. for the Allow header.
+     * METHOD_OTHER is not listed.
+     */
+    static std::string methodNames(std::uint32_t methods)
+    {
+        std::string names;
+        for (std::size_t i = 0; i < METHOD_COUNT; ++i)
+        {
+            if ((methods & (1u << i)) == 0)
+                continue;
+            if (!names.empty())
+                names += ", ";
+            names += methodName(i);
+        }
+        return names;
+    }
+
+    /**
+     * Add a handler for all methods and all paths below prefix, e.g.
+     * `/api` matches `/api` and `/api/users` but not `/apis`. The prefix is
+     * compiled with the default options without PR_END; literal prefixes are compared bytewise, see
+     * RouteClass. Handlers call Context::next() to pass the request on.
+     */
+    void use(const std::string &prefix, Handler handler)
+    {
+        addRoute(ALL_METHODS, "*", prefix, parsePath(prefix), defaultOptions_ & ~PR_END, std::move(handler));
+    }
+
+    /**
+     * Route requests for all paths below prefix with subRouter, which
+     * sees the rest of the path, see Context::path() and
+     * Context::basePath(). The rest is not copied. Requests which are not
+     * handled by subRouter continue with the routes after the mount point.
+     * subRouter is referenced by address and must outlive this router.
+     */
+    void mount(const std::string &prefix, const HttpRouter &subRouter)
+    {
+        const HttpRouter *sub = &subRouter;
+        use(prefix, [sub](RequestParamType, ResponseParamType, Context &ctx) {
+            ctx.descend(*sub);
+        });
+    }
+
+    /**
+     * Add a hook which loads a T for the values of the route parameter
+     * name, e.g. the account for `:accountId`. The hook runs once per
+     * request and value when a handler calls Context::load<T>(name), hooks
+     * that are not used cost nothing. A later hook for the same name
+     * replaces the earlier one.
+     *
+     * @param  name    name of the PathKey
+     * @param  loader  called with the context and the decoded parameter value
+     */
+    template <class T>
+    void param(const std::string &name, std::function<T(Context &, StringRef)> loader)
+    {
+        ParamHook hook;
+        hook.name = name;
+        hook.load = [loader](void *storage, Context &ctx, StringRef value) {
+            new (storage) T(loader(ctx, value));
+        };
+        hook.destroy = &destroyValue<T>;
+        hook.type = typeTag<T>();
+        hook.size = sizeof(T);
+        hook.alignment = alignof(T);
+        for (std::size_t i = 0; i < paramHooks_.size(); ++i)
+        {
+            if (paramHooks_[i].name == name)
+            {
+                paramHooks_[i] = std::move(hook);
+                return;
+            }
+        }
+        paramHooks_.push_back(std::move(hook));
+    }
+
+    /**
+     * Add a route for path without any method, e.g.
+     * `router.route("/users/:id").get(show).put(update).del(remove)`.
+     * The route keeps its position among the other routes when methods
+     * are added to it later.
+     */
+    RouteHandle route(const std::string &path)
+    {
+        return route(path, defaultOptions_);
+    }
+
+    /** Same as route(const std::string &) with options as for add() */
+    RouteHandle route(const std::string &path, int options)
+    {
+        addRoute(0, std::string(), path, parsePath(path), options, Handler());
+        const std::size_t index = routes_.size() - 1;
+        routes_[index].methodHandlers.resize(METHOD_COUNT);
+        return RouteHandle(*this, index);
+    }
+
+    std::size_t routeCount() const
+    {
+        return routes_.size();
+    }
+
+    /**
+     * Analysis of the route added at position index, in order of add() calls.
+     */
+    const RouteAnalysis & routeAnalysis(std::size_t index) const
+    {
+        return routes_.at(index).analysis;
+    }
+
+    /**
+     * When set, add() throws std::logic_error for routes of class
+     * RC_BACKTRACKING instead of matching them with std::regex.
+     */
+    void setRejectRiskyRoutes(bool reject)
+    {
+        rejectRiskyRoutes_ = reject;
+    }
+
+    /**
+     * When set (the default), the path is converted to lower case once per
+     * request and case-insensitive routes compare it bytewise instead of
+     * folding every character. Captures refer to the original path.
+     */
+    void setFoldCaseOnce(bool fold)
+    {
+        foldCaseOnce_ = fold;
+    }
+
+    /**
+     * Limit the length of routed paths (without the query string). Requests
+     * with longer paths are passed to handler, e.g. to respond with
+     * 414 URI Too Long, without running any matcher. Unlimited by default.
+     */
+    void setMaxPathLength(std::size_t length, Handler handler = Handler())
+    {
+        maxPathLength_ = length;
+        uriTooLongHandler_ = std::move(handler);
+    }
+
+    std::size_t maxPathLength() const
+    {
+        return maxPathLength_;
+    }
+
+    /**
+     * Normalize the path of every request with normalizePath() before it is
+     * routed. options is a combination of NormalizeOptions, 0 (the default)
+     * disables normalization. The path is rewritten in place in the
+     * request context, see Context::path() and Context::pathChanged().
+     */
+    void setPathNormalization(int options)
+    {
+        pathNormalization_ = options;
+    }
+
+    int pathNormalization() const
+    {
+        return pathNormalization_;
+    }
+
+    /**
+     * Options of the routes added without options, PR_END by default. Only
+     * routes added afterwards are affected; use() and mount() always clear
+     * PR_END.
+     */
+    void setDefaultOptions(int options)
+    {
+        defaultOptions_ = options;
+    }
+
+    int defaultOptions() const
+    {
+        return defaultOptions_;
+    }
+
+    /**
+     * Set the number of entries of the per-thread cache of (method, path)
+     * pairs which matched no route except catch-all routes such as `*`.
+     * Requests for cached pairs only try the catch-all routes. The cache is
+     * invalidated whenever routes are added or the router is assigned.
+     * Each thread keeps the caches of the last few routers it used, see
+     * CacheSet. 0 disables the cache, the default is 1024.
+     */
+    void setNegativeCacheSize(std::size_t entries)
+    {
+        negativeCacheSize_ = entries;
+        generation_ = nextGeneration();
+    }
+
+    std::size_t negativeCacheSize() const
+    {
+        return negativeCacheSize_;
+    }
+
+    /**
+     * Set the number of entries of the per-thread cache of the routes which
+     * matched recently seen (method, path) pairs, see ChainCache. Requests
+     * for cached pairs run the handlers of these routes with the cached
+     * captures and match no route until a handler passes the request on
+     * after the last cached route. The cache is invalidated and kept per
+     * router like the negative cache. 0 (the default) disables the cache.
+     */
+    void setChainCacheSize(std::size_t entries)
+    {
+        chainCacheSize_ = entries;
+        generation_ = nextGeneration();
+    }
+
+    std::size_t chainCacheSize() const
+    {
+        return chainCacheSize_;
+    }
+
+    void handleRequest(RequestParamType request, ResponseParamType response) const
+    {
+        Context ctx(request, response, *this);
+        ctx.handle();
+    }
+
+    /**
+     * Handle the requests [firstRequest, lastRequest) with the responses
+     * starting at firstResponse, in order, e.g. pipelined HTTP/1.1 requests.
+     * Same as calling handleRequest() for every pair, but the route table
+     * lookups of up to BATCH_SIZE requests are done together so that their
+     * cache misses overlap.
+     */
+    template <class RequestIterator, class ResponseIterator>
+    void handleRequests(RequestIterator firstRequest, RequestIterator lastRequest, ResponseIterator firstResponse) const
+    {
+        Lookup lookups[BATCH_SIZE];
+        MonotonicBufferPool::Lease buffer(threadBufferPool());
+        while (firstRequest != lastRequest)
+        {
+            buffer->release();
+            RequestIterator request = firstRequest;
+            std::size_t n = 0;
+            for (; n < BATCH_SIZE && firstRequest != lastRequest; ++n, ++firstRequest)
+            {
+                Lookup &lookup = lookups[n];
+                const std::string &uri = RequestTraits<Request>::getUriPath(*firstRequest);
+                lookup.uri = copyChars(*buffer, uri.data(), uri.size());
+                lookup.uriSize = uri.size();
+                std::size_t size = pathLength(lookup.uri, lookup.uriSize);
+                lookup.pathChanged = normalize(lookup.uri, lookup.uriSize, size);
+                prepareLookup(lookup, lookup.uri, size, *buffer);
+            }
+            lookupRoutes(lookups, lookups + n);
+            for (std::size_t i = 0; i < n; ++i, ++request, ++firstResponse)
+            {
+                Context ctx(*request, *firstResponse, *this, StringRef(lookups[i].uri, lookups[i].uriSize));
+                ctx.handle(&lookups[i]);
+            }
+        }
+    }
+
+    /**
+     * Find the first route which matches each path for method, without
+     * calling any handler. Paths of the same method are matched together,
+     * see handleRequests().
+     *
+     * @param  method  request method of all paths
+     * @param  paths   paths without query string
+     * @param  routes  receives per path the index of the first matching
+     *                 route in order of add() calls, or NO_ROUTE
+     */
+    void matchBatch(const std::string &method, const std::vector<std::string> &paths, std::vector<std::size_t> &routes) const
+    {
+        const std::uint32_t bit = methodBit(method);
+        Lookup lookups[BATCH_SIZE];
+        const char *batchPaths[BATCH_SIZE];
+        MonotonicBufferPool::Lease buffer(threadBufferPool());
+
+        routes.assign(paths.size(), NO_ROUTE);
+        for (std::size_t base = 0; base < paths.size(); base += BATCH_SIZE)
+        {
+            buffer->release();
+            Captures captures((MonotonicAllocator<std::size_t>(*buffer)));
+            const std::size_t n = std::min(BATCH_SIZE, paths.size() - base);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                const char *path = paths[base + i].data();
+                std::size_t size = paths[base + i].size();
+                if (pathNormalization_ != 0 && size <= maxPathLength_)
+                {
+                    char *out = buffer->allocateChars(size);
+                    size = HttpUtils::normalizePath(path, path + size, out, pathNormalization_) - out;
+                    path = out;
+                }
+                batchPaths[i] = path;
+                prepareLookup(lookups[i], path, size, *buffer);
+            }
+            lookupRoutes(lookups, lookups + n);
+
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                const Lookup &lookup = lookups[i];
+                if (lookup.pathSize > maxPathLength_)
+                    continue;
+                const std::vector<std::size_t> &candidates = *lookup.routes;
+                for (std::size_t c = 0, sz = candidates.size(); c < sz; ++c)
+                {
+                    const std::size_t index = candidates[c];
+                    if (acceptsRoute(index, bit, method, lookup.lowerPath, lookup.pathSize) &&
+                        matchRoute(index, batchPaths[i], lookup.lowerPath, lookup.pathSize, captures))
+                    {
+                        routes[base + i] = index;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+
+    /** Generation numbers are unique among all routers */
+    static std::uint64_t nextGeneration()
+    {
+        static std::atomic<std::uint64_t> generation(0);
+        return ++generation;
+    }
+
+    /** Negative caches of the calling thread, one per recently used router */
+    static CacheSet<NegativeCache> & threadNegativeCaches()
+    {
+        static thread_local CacheSet<NegativeCache> caches;
+        return caches;
+    }
+
+    /** Chain caches of the calling thread, one per recently used router */
+    static CacheSet<ChainCache> & threadChainCaches()
+    {
+        static thread_local CacheSet<ChainCache> caches;
+        return caches;
+    }
+
+    /**
+     * VM scratch memory of the calling thread. It is only used while a
+     * route is matched, so nested requests routed from handlers can share
+     * it. It grows to the largest VM program of any router and is then
+     * reused without allocating.
+     */
+    static PathMatcher::State & threadMatchState()
+    {
+        static thread_local PathMatcher::State state;
+        return state;
+    }
+
+    /** Pool of the request arenas of the calling thread */
+    static MonotonicBufferPool & threadBufferPool()
+    {
+        static thread_local MonotonicBufferPool pool;
+        return pool;
+    }
+
+    /** Whether the route matches every path */
+    static bool isCatchAll(const std::vector<PathToken> &tokens)
+    {
+        if (tokens.size() != 1 || tokens[0].which() == 0)
+            return false;
+        const PathKey &key = boost::get<PathKey>(tokens[0]);
+        return key.prefix.empty() && key.pattern == ".*";
+    }
+
+    /** First segment of a path, without the leading '/' */
+    static void firstPathSegment(const char *path, std::size_t size, const char *&first, const char *&last)
+    {
+        first = path + (size != 0 && path[0] == '/');
+        last = static_cast<const char *>(std::memchr(first, '/', path + size - first));
+        if (!last)
+            last = path + size;
+    }
+
+    /**
+     * Normalize the first pathSize characters of the URI in place and move
+     * the query string down to the new end of the path. Overlong paths are
+     * left alone, they are rejected before routing.
+     *
+     * @return true if the path changed
+     */
+    bool normalize(char *uri, std::size_t &uriSize, std::size_t &pathSize) const
+    {
+        if (pathNormalization_ == 0 || pathSize > maxPathLength_ || pathSize == 0)
+            return false;
+        const std::size_t size = HttpUtils::normalizePath(uri, uri + pathSize, uri, pathNormalization_) - uri;
+        if (size == pathSize)
+            return false;
+        std::memmove(uri + size, uri + pathSize, uriSize - pathSize);
+        uriSize -= pathSize - size;
+        pathSize = size;
+        return true;
+    }
+
+    /** Length of the path of a URI, without the query string */
+    static std::size_t pathLength(const char *uri, std::size_t size)
+    {
+        const char *query = static_cast<const char *>(std::memchr(uri, '?', size));
+        return query ? query - uri : size;
+    }
+
+    static char * copyChars(MonotonicBuffer &buffer, const char *first, std::size_t size)
+    {
+        char *out = buffer.allocateChars(size);
+        std::memcpy(out, first, size);
+        return out;
+    }
+
+    /** Lowercase the path of a request into buffer for lookupRoutes() */
+    void prepareLookup(Lookup &lookup, const char *path, std::size_t size, MonotonicBuffer &buffer) const
+    {
+        lookup.pathSize = size;
+        lookup.lowerPath = 0;
+        lookup.routes = 0;
+        if (size > maxPathLength_)
+            return;
+        char *out = buffer.allocateChars(size);
+        asciiToLower(path, path + size, out);
+        lookup.lowerPath = out;
+    }
+
+    /**
+     * Find the candidate routes of several requests. The hash tables are
+     * probed for all requests in turn and every probe is prefetched while
+     * the previous requests are processed, so that the cache misses of the
+     * requests overlap instead of adding up.
+     */
+    void lookupRoutes(Lookup *first, Lookup *last) const
+    {
+        for (Lookup *it = first; it != last; ++it)
+        {
+            if (it->pathSize > maxPathLength_ || staticRoutes_.empty())
+                continue;
+            const char *path = it->lowerPath;
+            it->hash = RouteTable::hash(path, path + it->pathSize);
+            staticRoutes_.prefetch(it->hash);
+        }
+        for (Lookup *it = first; it != last; ++it)
+        {
+            if (it->pathSize > maxPathLength_)
+                continue;
+            const char *path = it->lowerPath;
+            if (!staticRoutes_.empty())
+                it->routes = staticRoutes_.find(path, path + it->pathSize, it->hash);
+            if (!it->routes && !segmentRoutes_.empty())
+            {
+                const char *segmentFirst, *segmentLast;
+                firstPathSegment(path, it->pathSize, segmentFirst, segmentLast);
+                it->hash = RouteTable::hash(segmentFirst, segmentLast);
+                segmentRoutes_.prefetch(it->hash);
+            }
+        }
+        for (Lookup *it = first; it != last; ++it)
+        {
+            if (!it->routes && it->pathSize <= maxPathLength_ && !segmentRoutes_.empty())
+            {
+                const char *segmentFirst, *segmentLast;
+                firstPathSegment(it->lowerPath, it->pathSize, segmentFirst, segmentLast);
+                it->routes = segmentRoutes_.find(segmentFirst, segmentLast, it->hash);
+            }
+            if (!it->routes)
+                it->routes = &anyRoutes_;
+            if (!it->routes->empty())
+            {
+                const std::size_t index = it->routes->front();
+                detail::prefetch(&layout_.methods[index]);
+                detail::prefetch(&layout_.prefixTails[index]);
+            }
+        }
+    }
+
+    /**
+     * Whether the route accepts the method and the lowercased path starts
+     * with its literal prefix. Reads the hot arrays only.
+     */
+    bool acceptsRoute(std::size_t index, std::uint32_t bit, const std::string &method,
+                      const char *lowerPath, std::size_t size) const
+    {
+        const std::uint32_t methods = layout_.methods[index];
+        if ((methods & bit) == 0)
+            return false;
+        if (bit == METHOD_OTHER && methods != ALL_METHODS && !acceptsOtherMethod(routes_[index], method))
+            return false;
+        return acceptsPrefix(index, lowerPath, size);
+    }
+
+    /** Whether the lowercased path starts with the literal prefix of the route */
+    bool acceptsPrefix(std::size_t index, const char *lowerPath, std::size_t size) const
+    {
+        const std::uint32_t prefixLength = layout_.prefixLengths[index];
+        return prefixLength <= size && prefixTail(lowerPath + prefixLength, prefixLength) == layout_.prefixTails[index];
+    }
+
+    /** Routes which may match the lowercased path, see lookupRoutes() */
+    const std::vector<std::size_t> & findRoutes(const char *lowerPath, std::size_t size) const
+    {
+        const std::vector<std::size_t> *routes = 0;
+        if (!staticRoutes_.empty())
+            routes = staticRoutes_.find(lowerPath, lowerPath + size);
+        if (!routes && !segmentRoutes_.empty())
+        {
+            const char *segmentFirst, *segmentLast;
+            firstPathSegment(lowerPath, size, segmentFirst, segmentLast);
+            routes = segmentRoutes_.find(segmentFirst, segmentLast);
+        }
+        return routes ? *routes : anyRoutes_;
+    }
+
+    /**
+     * Union of the method sets of the groups of the candidate routes which
+     * match the path, catch-all routes excluded. A route is only matched
+     * when its group adds methods, so every group is matched at most once.
+     */
+    std::uint32_t allowedMethods(const std::vector<std::size_t> &candidates, const char *path,
+                                 const char *lowerPath, std::size_t size, Captures &captures) const
+    {
+        std::uint32_t allowed = 0;
+        for (std::size_t i = 0, n = candidates.size(); i < n; ++i)
+        {
+            const std::size_t index = candidates[i];
+            const Route &route = routes_[index];
+            const std::uint32_t methods = groupMethods_[route.group];
+            if (!route.endpoint || (allowed | methods) == allowed)
+                continue;
+            if (acceptsPrefix(index, lowerPath, size) && matchRoute(index, path, lowerPath, size, captures))
+                allowed |= methods;
+        }
+        return allowed;
+    }
+
+    /**
+     * Match the route against the path and store the begin and end offsets
+     * of all groups in captures. lowerPath is the path converted with
+     * asciiToLower().
+     */
+    bool matchRoute(std::size_t index, const char *path, const char *lowerPath, std::size_t size,
+                    Captures &captures) const
+    {
+        if (layout_.engineKinds[index] == STATIC_MATCH)
+        {
+            // Only found by the lookup of the lowercased path in the static route table.
+            captures.resize(2);
+            captures[0] = 0;
+            captures[1] = size;
+            return true;
+        }
+        if (layout_.engineKinds[index] == RC_BACKTRACKING)
+            return matchRegex(regexes_[layout_.engineIndices[index]], path, path + size, captures);
+
+        const PathMatcher &engine = engines_[layout_.engineIndices[index]];
+        captures.resize(engine.captureSize());
+        PathMatcher::State &state = threadMatchState();
+        if (foldCaseOnce_ && !engine.caseSensitive())
+        {
+            // The path is lowercased once for all case-insensitive routes.
+            return engine.matchLowercase(lowerPath, lowerPath + size, captures.data(), state);
+        }
+        return engine.match(path, path + size, captures.data(), state);
+    }
+
+    const ParamHook * findParamHook(const std::string &name) const
+    {
+        for (std::size_t i = 0, n = paramHooks_.size(); i < n; ++i)
+        {
+            if (paramHooks_[i].name == name)
+                return &paramHooks_[i];
+        }
+        return 0;
+    }
+
+    /** Address which identifies the type T */
+    template <class T>
+    static const void * typeTag()
+    {
+        static const char tag = 0;
+        return &tag;
+    }
+
+    template <class T>
+    static void destroyValue(void *value)
+    {
+        static_cast<T *>(value)->~T();
+    }
+
+    /** Name of the method with bit 1 << index */
+    static const char * methodName(std::size_t index)
+    {
+        static const char *const NAMES[METHOD_COUNT] = {
+            "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"
+        };
+        return NAMES[index];
+    }
+
+    static std::uint32_t methodBit(const std::string &method)
+    {
+        for (std::size_t i = 0; i < METHOD_COUNT; ++i)
+        {
+            if (method == methodName(i))
+                return 1u << i;
+        }
+        return METHOD_OTHER;
+    }
+
+    /** Position of the bit of a method other than METHOD_OTHER */
+    static std::size_t methodIndex(std::uint32_t bit)
+    {
+#ifdef __GNUC__
+        return static_cast<std::size_t>(__builtin_ctz(bit));
+#else
+        std::size_t index = 0;
+        while ((bit >>= 1) != 0)
+            ++index;
+        return index;
+#endif
+    }
+
+    /** Whether the route accepts a method without a bit of its own */
+    static bool acceptsOtherMethod(const Route &route, const std::string &method)
+    {
+        if (route.methodHandlers.empty())
+            return route.method == method;
+        for (std::size_t i = 0, n = route.otherHandlers.size(); i < n; ++i)
+        {
+            if (route.otherHandlers[i].first == method)
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * Handler of an accepted route for the method, looked up in the
+     * method table of a route created by route().
+     */
+    static const Handler & routeHandler(const Route &route, std::uint32_t bit, const std::string &method)
+    {
+        if (route.methodHandlers.empty())
+            return route.handler;
+        if (bit != METHOD_OTHER)
+        {
+            const Handler &handler = route.methodHandlers[methodIndex(bit)];
+            return handler ? handler : route.handler;
+        }
+        for (std::size_t i = 0, n = route.otherHandlers.size(); i < n; ++i)
+        {
+            if (route.otherHandlers[i].first == method)
+                return route.otherHandlers[i].second;
+        }
+        return route.handler;
+    }
+
+    void setRouteHandler(std::size_t index, const std::string &method, Handler &&handler)
+    {
+        Route &route = routes_[index];
+        const std::uint32_t bit = methodMask(method);
+        if (bit == ALL_METHODS)
+        {
+            route.handler = std::move(handler);
+        }
+        else if (bit != METHOD_OTHER)
+        {
+            route.methodHandlers[methodIndex(bit)] = std::move(handler);
+        }
+        else
+        {
+            std::size_t i = 0;
+            while (i < route.otherHandlers.size() && route.otherHandlers[i].first != method)
+                ++i;
+            if (i == route.otherHandlers.size())
+                route.otherHandlers.push_back(std::make_pair(method, std::move(handler)));
+            else
+                route.otherHandlers[i].second = std::move(handler);
+        }
+        layout_.methods[index] |= bit;
+        if (route.endpoint)
+            groupMethods_[route.group] |= bit;
+        // Requests for the method may have been cached as not found.
+        generation_ = nextGeneration();
+    }
+
+    /** Mask of the methods accepted by a route, empty and `*` accept all */
+    static std::uint32_t methodMask(const std::string &method)
+    {
+        return (method.empty() || method == "*") ? ALL_METHODS : methodBit(method);
+    }
+
+    /**
+     * The up to eight bytes in front of last packed into an integer. For the
+     * lowercased path, prefixTail(path + length, length) equals the tail of
+     * any literal prefix of that length the path starts with.
+     */
+    static std::uint64_t prefixTail(const char *last, std::size_t length)
+    {
+        std::uint64_t tail = 0;
+        const std::size_t n = std::min<std::size_t>(length, sizeof(tail));
+        std::memcpy(&tail, last - n, n);
+        return tail;
+    }
+
+    /**
+     * Lowercased literal every path matched by the route starts with.
+     */
+    static std::string literalPrefix(const std::vector<PathToken> &tokens, int options)
+    {
+        if (tokens.empty() || tokens[0].which() != 0)
+            return std::string();
+
+        std::string prefix = boost::get<std::string>(tokens[0]);
+        // Non-strict routes match without the trailing slash as well.
+        if ((options & PR_STRICT) == 0 && tokens.size() == 1 &&
+            !prefix.empty() && prefix[prefix.size() - 1] == '/')
+            prefix.erase(prefix.size() - 1);
+        asciiToLower(prefix.data(), prefix.data() + prefix.size(), &prefix[0]);
+        return prefix;
+    }
+
+    /**
+     * Match the path with std::regex and store the begin and end offsets of
+     * all groups in captures, PathMatcher::npos for groups which did not
+     * participate.
+     */
+    static bool matchRegex(const std::regex &regex, const char *first, const char *last,
+                           Captures &captures)
+    {
+        // The match state is allocated from the arena of the captures.
+        std::match_results<const char *, MonotonicAllocator<std::csub_match> > m(
+            (MonotonicAllocator<std::csub_match>(captures.get_allocator())));
+        if (!std::regex_search(first, last, m, regex))
+            return false;
+        captures.resize(2 * m.size());
+        for (std::size_t i = 0; i < m.size(); ++i)
+        {
+            captures[2 * i] = m[i].matched ? m[i].first - first : PathMatcher::npos;
+            captures[2 * i + 1] = m[i].matched ? m[i].second - first : PathMatcher::npos;
+        }
+        return true;
+    }
+
+    /**
+     * Compile and add a route. Every route is analyzed, routes outside of
+     * the linear-time subset of PathMatcher fall back to std::regex.
+     */
+    void addRoute(std::uint32_t methods, const std::string &method, const std::string &path,
+                  const std::vector<PathToken> &tokens, int options, Handler &&handler)
+    {
+        addRoute(methods, method, path, tokens, options, compileRoute(path, tokens, options), std::move(handler));
+    }
+
+    /** Engine of a route which has not been added yet, see compileRoute() */
+    struct CompiledRoute
+    {
+        PathMatcher engine;
+        RouteAnalysis analysis;
+        /** Only for routes which PathMatcher does not support */
+        std::regex regex;
+    };
+
+    /**
+     * Analyze and compile a route without adding it, so that a route which
+     * is rejected leaves the router unchanged.
+     *
+     * @throw std::logic_error if the route is rejected, see setRejectRiskyRoutes()
+     */
+    CompiledRoute compileRoute(const std::string &path, const std::vector<PathToken> &tokens, int options) const
+    {
+        CompiledRoute compiled;
+        compiled.engine = PathMatcher(tokens, options);
+        const RegExp re = tokensToRegExp(tokens, options);
+        compiled.analysis = analyzeRoute(compiled.engine, re.first);
+        if (rejectRiskyRoutes_ && compiled.analysis.routeClass == RC_BACKTRACKING)
+            throw std::logic_error("Route " + path + " requires a backtracking matcher, worst case " + compiled.analysis.complexity());
+        if (!compiled.engine.supported())
+            compiled.regex = to_regex(re);
+        return compiled;
+    }
+
+    void addRoute(std::uint32_t methods, const std::string &method, const std::string &path,
+                  const std::vector<PathToken> &tokens, int options, CompiledRoute &&compiled, Handler &&handler)
+    {
+        PathMatcher &engine = compiled.engine;
+        const RouteAnalysis &analysis = compiled.analysis;
+
+        Route route;
+        route.method = method;
+        route.path = path;
+        for (auto it = tokens.begin(), et = tokens.end(); it != et; ++it)
+        {
+            if (it->which() != 0)
+            {
+                route.keys.push_back(boost::get<PathKey>(*it));
+                const PathKey &key = route.keys.back();
+                route.formats.push_back(key.repeat ? PF_ANY : paramFormat(key.pattern));
+            }
+        }
+        route.handler = std::move(handler);
+        route.analysis = analysis;
+        route.catchAll = isCatchAll(tokens);
+
+        // Routes with the same path and options match the same paths.
+        const std::string groupKey = std::to_string(options) + ' ' + path;
+        const auto group = groupIndices_.insert(std::make_pair(groupKey, groupMethods_.size()));
+        if (group.second)
+            groupMethods_.push_back(0);
+        route.group = group.first->second;
+        // Prefixes mounted with use() or mount() do not answer for methods.
+        route.endpoint = !route.catchAll && (options & PR_END) != 0;
+        if (route.endpoint)
+            groupMethods_[route.group] |= methods;
+        route.alternative = 0;
+        route.alternatives = 1;
+
+        const std::string prefix = literalPrefix(tokens, options);
+        const std::size_t index = routes_.size();
+        routes_.push_back(std::move(route));
+        layout_.methods.push_back(methods);
+        layout_.prefixTails.push_back(prefixTail(prefix.data() + prefix.size(), prefix.size()));
+        layout_.prefixLengths.push_back(static_cast<std::uint32_t>(prefix.size()));
+        layout_.engineKinds.push_back(static_cast<std::uint8_t>(analysis.routeClass));
+        if (engine.supported())
+        {
+            maxProgramSize_ = std::max(maxProgramSize_, engine.programSize());
+            maxCaptureSize_ = std::max(maxCaptureSize_, engine.captureSize());
+            layout_.engineIndices.push_back(static_cast<std::uint32_t>(engines_.size()));
+            engines_.push_back(std::move(engine));
+        }
+        else
+        {
+            layout_.engineIndices.push_back(static_cast<std::uint32_t>(regexes_.size()));
+            regexes_.push_back(std::move(compiled.regex));
+            maxCaptureSize_ = std::max<std::size_t>(maxCaptureSize_, 2 * (regexes_.back().mark_count() + 1));
+        }
+
+        if (routes_.back().catchAll)
+            catchAllRoutes_.push_back(index);
+        generation_ = nextGeneration();
+
+        if (addStaticRoute(tokens, options, index))
+        {
+            if ((options & PR_SENSITIVE) == 0)
+                layout_.engineKinds[index] = STATIC_MATCH;
+        }
+        else
+        {
+            dynamicRoutes_.push_back(index);
+            staticRoutes_.addIf(index, [this, index](const std::string &key) { return mayMatch(index, key); });
+            addSegmentRoute(tokens, options, index);
+        }
+    }
+
+    /**
+     * Whether the route may match a path which is equal to the lowercased
+     * path key when case is ignored.
+     */
+    bool mayMatch(std::size_t index, const std::string &key) const
+    {
+        if (layout_.engineKinds[index] == RC_BACKTRACKING)
+            return true;
+        const PathMatcher &engine = engines_[layout_.engineIndices[index]];
+        // A case-sensitive route still has to start with its literal prefix.
+        if (engine.caseSensitive())
+            return acceptsPrefix(index, key.data(), key.size());
+        std::vector<std::size_t> captures(engine.captureSize());
+        return engine.matchLowercase(key.data(), key.data() + key.size(), captures.data());
+    }
+
+    /**
+     * Add a key for the exact path to the static route table. The entry
+     * lists all routes which may match the path, so that a request for it
+     * never needs to try any other route.
+     */
+    void addStaticKey(const std::string &key, std::size_t index)
+    {
+        const std::vector<std::size_t> *routes = staticRoutes_.find(key.data(), key.data() + key.size());
+        if (!routes)
+        {
+            for (std::vector<std::size_t>::const_iterator it = dynamicRoutes_.begin(), et = dynamicRoutes_.end(); it != et; ++it)
+            {
+                if (mayMatch(*it, key))
+                    staticRoutes_.add(key, *it);
+            }
+        }
+        staticRoutes_.add(key, index);
+    }
+
+    /**
+     * Lowercased first path segment of all paths matched by the route.
+     *
+     * @return false if the segment is not a literal
+     */
+    static bool firstSegment(const std::vector<PathToken> &tokens, std::string &segment)
+    {
+        if (tokens.empty() || tokens[0].which() != 0)
+            return false;
+
+        const std::string &literal = boost::get<std::string>(tokens[0]);
+        const std::size_t first = (!literal.empty() && literal[0] == '/') ? 1 : 0;
+        const std::size_t last = literal.find('/', first);
+
+        // The segment must not continue in the next token.
+        if (last == std::string::npos && tokens.size() > 1 &&
+            (tokens[1].which() == 0 || boost::get<PathKey>(tokens[1]).prefix != "/"))
+            return false;
+
+        segment = literal.substr(first, last == std::string::npos ? std::string::npos : last - first);
+        asciiToLower(segment.data(), segment.data() + segment.size(), &segment[0]);
+        return true;
+    }
+
+    /**
+     * Put a route with parameters into the bucket of its first path segment,
+     * or into all buckets if the segment is not a literal. Every bucket lists
+     * its own routes and those of the "any" bucket in registration order.
+     */
+    void addSegmentRoute(const std::vector<PathToken> &tokens, int options, std::size_t index)
+    {
+        std::string segment;
+        // A prefix without a first segment, e.g. use("/"), matches any path.
+        if (!firstSegment(tokens, segment) || (segment.empty() && (options & PR_END) == 0))
+        {
+            anyRoutes_.push_back(index);
+            segmentRoutes_.addIf(index, [](const std::string &) { return true; });
+            return;
+        }
+        if (!segmentRoutes_.find(segment.data(), segment.data() + segment.size()))
+        {
+            for (std::vector<std::size_t>::const_iterator it = anyRoutes_.begin(), et = anyRoutes_.end(); it != et; ++it)
+                segmentRoutes_.add(segment, *it);
+        }
+        segmentRoutes_.add(segment, index);
+    }
+
+    /**
+     * Index routes without parameters by their exact path. The table is
+     * keyed by the lowercased path, the route itself still verifies the
+     * method and case-sensitive paths.
+     *
+     * @return false if the route is not static
+     */
+    bool addStaticRoute(const std::vector<PathToken> &tokens, int options, std::size_t index)
+    {
+        if (tokens.size() > 1 || (tokens.size() == 1 && tokens[0].which() != 0) || (options & PR_END) == 0)
+            return false;
+
+        std::string path = tokens.empty() ? std::string() : boost::get<std::string>(tokens[0]);
+        asciiToLower(path.data(), path.data() + path.size(), &path[0]);
+        if ((options & PR_STRICT) != 0)
+        {
+            addStaticKey(path, index);
+        }
+        else
+        {
+            // With and without the trailing slash.
+            if (!path.empty() && path[path.size() - 1] == '/')
+                path.erase(path.size() - 1);
+            addStaticKey(path, index);
+            addStaticKey(path + "/", index);
+        }
+        return true;
+    }
+
+    RouteList routes_;
+    RouteLayout layout_;
+    std::vector<PathMatcher> engines_;
+    std::vector<std::regex> regexes_;
+    RouteTable staticRoutes_;
+    std::vector<std::size_t> dynamicRoutes_;
+    RouteTable segmentRoutes_;
+    std::vector<std::size_t> anyRoutes_;
+    std::vector<std::size_t> catchAllRoutes_;
+    std::vector<ParamHook> paramHooks_;
+    /** Union of the methods of the routes of each group, see Route::group */
+    std::vector<std::uint32_t> groupMethods_;
+    std::unordered_map<std::string, std::size_t> groupIndices_;
+    std::uint64_t generation_;
+    std::size_t negativeCacheSize_;
+    std::size_t chainCacheSize_;
+    std::size_t maxProgramSize_;
+    std::size_t maxCaptureSize_;
+    std::size_t maxPathLength_;
+    int pathNormalization_;
+    int defaultOptions_;
+    Handler uriTooLongHandler_;
+    bool rejectRiskyRoutes_;
+    bool foldCaseOnce_;
+};
+
+template <class Request, class Response>
+const std::size_t HttpRouter<Request, Response>::NO_ROUTE;
+
+template <class Request, class Response>
+const std::size_t HttpRouter<Request, Response>::BATCH_SIZE;
+
+template <class Request, class Response>
+const std::uint32_t HttpRouter<Request, Response>::METHOD_OTHER;
+
+template <class Request, class Response>
+const std::size_t HttpRouter<Request, Response>::METHOD_COUNT;
+
+template <class Request, class Response>
+const std::uint8_t HttpRouter<Request, Response>::STATIC_MATCH;
+
+template <class Request, class Response>
+const std::uint32_t HttpRouter<Request, Response>::ALL_METHODS;
 
 } // namespace HttpUtils
 
@@ -0,0 +1,1535 @@
+/*
+ * HttpUtilsBench.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+#include "PathToRegexp.hpp"
+#include "HttpRouter.hpp"
+#include "PathMatcher.hpp"
+#include "UriUtils.hpp"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <cstdio>
+#include <random>
+#include <cstdlib>
+#include <new>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace HttpUtils;
+
+struct BenchRequest
+{
+    std::string method;
+    std::string uriPath;
+};
+
+struct BenchResponse
+{
+    std::size_t handled;
+};
+
+namespace HttpUtils
+{
+
+template <>
+struct RequestTraits<BenchRequest>
+{
+    typedef BenchRequest & value_type;
+    typedef value_type param_type;
+
+    static std::string getMethod(param_type request)
+    {
+        return request.method;
+    }
+
+    static std::string getUriPath(param_type request)
+    {
+        return request.uriPath;
+    }
+};
+
+} // namespace HttpUtils
+
+typedef HttpRouter<BenchRequest, BenchResponse> BenchRouter;
+
+/** Number of global heap allocations, counted by the replaced operator new */
+static std::atomic<std::size_t> heapAllocations(0);
+
+void * operator new(std::size_t size)
+{
+    ++heapAllocations;
+    if (void *ptr = std::malloc(size != 0 ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+/** Prevents the optimizer from removing computations whose result is unused */
+static volatile std::size_t sink;
+
+inline double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(const char *name, std::size_t ops, double seconds)
+{
+    std::printf("%-48s %12.1f ns/op %14.0f ops/s\n", name,
+                seconds * 1e9 / ops, ops / seconds);
+}
+
+/**
+ * Hardware cache miss counter of the calling thread. Reports nothing where
+ * perf events are not available, e.g. outside of Linux or in containers.
+ */
+class CacheMissCounter
+{
+public:
+    CacheMissCounter()
+        : fd_(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (fd_ != -1)
+            close(fd_);
+#endif
+    }
+
+    bool available() const { return fd_ != -1; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd_ != -1)
+        {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /** Cache misses since start() */
+    std::uint64_t stop()
+    {
+        std::uint64_t count = 0;
+#ifdef __linux__
+        if (fd_ != -1)
+        {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+#endif
+        return count;
+    }
+
+private:
+    CacheMissCounter(const CacheMissCounter &) = delete;
+    CacheMissCounter & operator=(const CacheMissCounter &) = delete;
+
+    int fd_;
+};
+
+// ---------------------------------------------------------------------------
+// PathFunction shared between threads
+// ---------------------------------------------------------------------------
+
+void benchPathFunctionThreads()
+{
+    // One global, const table of compiled link templates used by all workers.
+    const std::vector<PathFunction> links = {
+        compilePath("/user/:id"),
+        compilePath("/user/:id(\\d+)/posts/:post"),
+        compilePath("/files/:path+"),
+        compilePath("/:postType(video|audio|text)")
+    };
+    std::vector<SegmentMap> data(links.size());
+    data[0]["id"] = {"u-4f2a91c7"};
+    data[1]["id"] = {"1234567"};
+    data[1]["post"] = {"hello world"};
+    data[2]["path"] = {"a", "b", "c.txt"};
+    data[3]["postType"] = {"video"};
+
+    const std::size_t opsPerThread = 100000;
+    const unsigned hwThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned nthreads = 1; nthreads <= std::max(8u, hwThreads); nthreads *= 2)
+    {
+        std::atomic<std::size_t> total(0);
+        std::vector<std::thread> workers;
+        Clock::time_point start = Clock::now();
+        for (unsigned t = 0; t < nthreads; ++t)
+        {
+            workers.emplace_back([&links, &data, &total, opsPerThread]() {
+                std::size_t len = 0;
+                for (std::size_t i = 0; i < opsPerThread; ++i)
+                {
+                    const std::size_t k = i % links.size();
+                    len += links[k](data[k]).size();
+                }
+                total += len;
+            });
+        }
+        for (auto &w : workers)
+            w.join();
+        const double seconds = secondsSince(start);
+        sink = total;
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "PathFunction shared, %u thread(s)", nthreads);
+        report(name, opsPerThread * nthreads, seconds);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Validation of encoded values against key patterns
+// ---------------------------------------------------------------------------
+
+void benchPathFunctionValidate()
+{
+    const std::size_t ops = 200000;
+    const char *patterns[] = { "[^\\/]+?", "\\d+", "video|audio|text" };
+    const char *values[] = { "u-4f2a91c7", "1234567", "audio" };
+
+    for (std::size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); ++p)
+    {
+        const std::string value = values[p];
+        const std::regex re("^" + std::string(patterns[p]) + "$");
+        Clock::time_point start = Clock::now();
+        std::size_t hits = 0;
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            std::smatch res;
+            hits += std::regex_search(value, res, re);
+        }
+        const double regexSeconds = secondsSince(start);
+
+        const PathValidator validator(patterns[p]);
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            hits += validator(value);
+        const double validatorSeconds = secondsSince(start);
+        sink = hits;
+
+        std::string name = std::string("std::regex     ") + patterns[p];
+        report(name.c_str(), ops, regexSeconds);
+        name = std::string("PathValidator  ") + patterns[p];
+        report(name.c_str(), ops, validatorSeconds);
+    }
+
+    SegmentMap data;
+    data["id"] = {"1234567"};
+    data["post"] = {"hello world"};
+    const PathFunction validated = compilePath("/user/:id(\\d+)/posts/:post");
+    const PathFunction trusted = compilePath("/user/:id(\\d+)/posts/:post", PF_TRUSTED_INPUT);
+
+    std::size_t len = 0;
+    Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < ops; ++i)
+        len += validated(data).size();
+    report("PathFunction validated", ops, secondsSince(start));
+
+    start = Clock::now();
+    for (std::size_t i = 0; i < ops; ++i)
+        len += trusted(data).size();
+    report("PathFunction PF_TRUSTED_INPUT", ops, secondsSince(start));
+    sink = len;
+}
+
+// ---------------------------------------------------------------------------
+// encodeURIComponent
+// ---------------------------------------------------------------------------
+
+/** Character by character implementation formerly used by PathFunction */
+std::string encodeURIComponentReference(const std::string &s)
+{
+    std::string v;
+    v.reserve(s.size());
+    for (size_t i = 0, l = s.size(); i < l; i++)
+    {
+        const char c = s[i];
+        if ((c >= '0' && c <= '9') ||
+            (c >= 'a' && c <= 'z') ||
+            (c >= 'A' && c <= 'Z') ||
+            c == '-' || c == '_' || c == '.' || c == '!' || c == '~' ||
+            c == '*' || c == '\'' || c == '(' || c == ')')
+        {
+            v += c;
+        }
+        else if (c == ' ')
+        {
+            v += '+';
+        }
+        else
+        {
+            const unsigned char u = c;
+            v += '%';
+            v += "0123456789ABCDEF"[u / 16];
+            v += "0123456789ABCDEF"[u % 16];
+        }
+    }
+    return v;
+}
+
+void benchEncodeURIComponent()
+{
+    std::string opaqueId;
+    std::string base64;
+    const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (std::size_t i = 0; i < 256; ++i)
+    {
+        opaqueId += "0123456789abcdef"[(i * 7 + 3) % 16];
+        if (i % 32 == 31)
+            opaqueId += '-';
+        base64 += alphabet[(i * 37 + 11) % 64];
+    }
+    base64 += "==";
+
+    struct Input { const char *name; std::string value; };
+    const Input inputs[] = {
+        { "short id", "u-4f2a91c7" },
+        { "opaque id (263 bytes)", opaqueId },
+        { "base64 token (258 bytes)", base64 },
+        { "path with spaces", "my documents/annual report 2015.pdf" }
+    };
+
+    const std::size_t ops = 200000;
+    for (const Input &input : inputs)
+    {
+        std::size_t len = 0;
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            len += encodeURIComponentReference(input.value).size();
+        std::string name = std::string("reference    ") + input.name;
+        report(name.c_str(), ops, secondsSince(start));
+
+        std::string out;
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            out.clear();
+            encodeURIComponent(input.value.data(), input.value.data() + input.value.size(), out);
+            len += out.size();
+        }
+        name = std::string("table/SIMD   ") + input.name;
+        report(name.c_str(), ops, secondsSince(start));
+        sink = len;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// decodeURIComponent
+// ---------------------------------------------------------------------------
+
+/** Typical per-handler decoding loop */
+std::string decodeURIComponentReference(const std::string &s)
+{
+    std::string v;
+    for (std::size_t i = 0; i < s.size(); ++i)
+    {
+        if (s[i] == '+')
+            v += ' ';
+        else if (s[i] == '%' && i + 2 < s.size() && std::isxdigit(s[i + 1]) && std::isxdigit(s[i + 2]))
+        {
+            v += static_cast<char>(std::stoi(s.substr(i + 1, 2), 0, 16));
+            i += 2;
+        }
+        else
+            v += s[i];
+    }
+    return v;
+}
+
+void benchDecodeURIComponent()
+{
+    std::string opaqueId;
+    for (std::size_t i = 0; i < 256; ++i)
+        opaqueId += "0123456789abcdef"[(i * 7 + 3) % 16];
+
+    struct Input { const char *name; std::string value; };
+    const Input inputs[] = {
+        { "short id", "u-4f2a91c7" },
+        { "opaque id (256 bytes)", opaqueId },
+        { "escaped path", "my+documents%2Fannual+report+2015.pdf" }
+    };
+
+    const std::size_t ops = 200000;
+    for (const Input &input : inputs)
+    {
+        std::size_t len = 0;
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            len += decodeURIComponentReference(input.value).size();
+        std::string name = std::string("reference    ") + input.name;
+        report(name.c_str(), ops, secondsSince(start));
+
+        // Same strategy as Context::param(): return a view if nothing to decode.
+        std::vector<char> buffer(input.value.size());
+        const char *first = input.value.data();
+        const char *last = first + input.value.size();
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            if (findURIEscape(first, last) == last)
+                len += last - first;
+            else
+                len += decodeURIComponent(first, last, buffer.data()) - buffer.data();
+        }
+        name = std::string("SIMD         ") + input.name;
+        report(name.c_str(), ops, secondsSince(start));
+        sink = len;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Route matching on adversarial paths
+// ---------------------------------------------------------------------------
+
+void benchAdversarialPaths()
+{
+    struct Route { const char *path; char fill; const char *suffix; std::size_t maxRegexLength; };
+    // std::regex recurses per character, so long inputs are only given to
+    // PathMatcher to avoid overflowing the stack.
+    const Route routes[] = {
+        { "/:postType(video|audio|text)(\\+.+)?", 'x', "", 4096 },
+        { "/:postType(video|audio|text)(\\+.+)?", '+', "", 4096 },
+        { "*", 'a', "", 4096 },
+        { "/:word(\\w+\\w+\\w+)\\.json", 'a', "!", 64 }
+    };
+
+    for (const Route &route : routes)
+    {
+        const std::vector<PathToken> tokens = parsePath(route.path);
+        const std::regex re = to_regex(tokensToRegExp(tokens));
+        const PathMatcher matcher(tokens);
+        std::vector<std::size_t> captures(matcher.captureSize());
+
+        for (std::size_t length = 64; length <= 1024 * 1024; length *= 4)
+        {
+            const std::string path = std::string(route.fill == '+' ? "/video" : "/") +
+                std::string(length, route.fill) + route.suffix;
+            const std::size_t ops = std::max<std::size_t>(1, (1 << 20) / length);
+            std::size_t hits = 0;
+            char name[96];
+
+            if (length <= route.maxRegexLength)
+            {
+                Clock::time_point start = Clock::now();
+                for (std::size_t i = 0; i < ops; ++i)
+                {
+                    std::smatch res;
+                    hits += std::regex_search(path, res, re);
+                }
+                std::snprintf(name, sizeof(name), "std::regex   %s '%c'x%zu", route.path, route.fill, length);
+                report(name, ops, secondsSince(start));
+            }
+
+            Clock::time_point start = Clock::now();
+            for (std::size_t i = 0; i < ops; ++i)
+                hits += matcher.match(path.data(), path.data() + path.size(), captures.data());
+            std::snprintf(name, sizeof(name), "PathMatcher  %s '%c'x%zu", route.path, route.fill, length);
+            report(name, ops, secondsSince(start));
+            sink = hits;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Case-insensitive matching
+// ---------------------------------------------------------------------------
+
+void benchCaseFolding()
+{
+    const char *routes[] = {
+        "/api/v1/users/:id(\\d+)", "/api/v1/users/:id(\\d+)/posts", "/api/v1/groups/:group",
+        "/api/v1/groups/:group/members/:member", "/static/:file(\\w+\\.css)",
+        "/api/v1/orders/:order([0-9a-f]{8})/items", "/api/v1/search/:terms([a-z]+-[\\w-]+)"
+    };
+    const char *paths[] = {
+        "/API/V1/Groups/Administrators/Members/JohnDoe",
+        "/API/v1/Search/Annual-Report-Of-The-Northern-Division-Sales-2015"
+    };
+    const std::size_t ops = 100000;
+    const int rounds = 5;
+
+    std::vector<std::regex> regexes;
+    std::vector<PathMatcher> matchers;
+    for (const char *route : routes)
+    {
+        const std::vector<PathToken> tokens = parsePath(route);
+        regexes.push_back(to_regex(tokensToRegExp(tokens)));
+        matchers.push_back(PathMatcher(tokens));
+    }
+    std::vector<std::size_t> captures(64);
+    std::size_t hits = 0;
+
+    for (const char *p : paths)
+    {
+        const std::string path = p;
+        std::string lower(path.size(), '\0');
+        double regexSeconds = 1e9, perCharSeconds = 1e9, onceSeconds = 1e9;
+
+        // Best of several rounds, the matchers allocate and timings are noisy.
+        for (int round = 0; round < rounds; ++round)
+        {
+            Clock::time_point start = Clock::now();
+            for (std::size_t i = 0; i < ops / 10; ++i)
+            {
+                for (const std::regex &re : regexes)
+                {
+                    std::smatch res;
+                    hits += std::regex_search(path, res, re);
+                }
+            }
+            regexSeconds = std::min(regexSeconds, secondsSince(start));
+
+            start = Clock::now();
+            for (std::size_t i = 0; i < ops; ++i)
+            {
+                for (const PathMatcher &m : matchers)
+                    hits += m.match(path.data(), path.data() + path.size(), captures.data());
+            }
+            perCharSeconds = std::min(perCharSeconds, secondsSince(start));
+
+            start = Clock::now();
+            for (std::size_t i = 0; i < ops; ++i)
+            {
+                asciiToLower(path.data(), path.data() + path.size(), &lower[0]);
+                for (const PathMatcher &m : matchers)
+                    hits += m.matchLowercase(lower.data(), lower.data() + lower.size(), captures.data());
+            }
+            onceSeconds = std::min(onceSeconds, secondsSince(start));
+        }
+
+        std::printf("%s\n", p);
+        report("  std::regex icase", ops / 10, regexSeconds);
+        report("  PathMatcher, fold per character", ops, perCharSeconds);
+        report("  PathMatcher, fold once", ops, onceSeconds);
+    }
+
+    std::string longPath(4096, 'A');
+    Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < ops; ++i)
+        asciiToLower(longPath.data(), longPath.data() + longPath.size(), &longPath[0]);
+    report("asciiToLower 4096 bytes", ops, secondsSince(start));
+    sink = hits + longPath[0];
+}
+
+// ---------------------------------------------------------------------------
+// Router with a typical REST API
+// ---------------------------------------------------------------------------
+
+const char *API_RESOURCES[] = {
+    "users", "groups", "orders", "invoices", "products", "carts", "payments", "shipments",
+    "reviews", "coupons", "stores", "employees", "suppliers", "warehouses", "returns",
+    "messages", "sessions", "reports", "webhooks", "settings"
+};
+
+/**
+ * Per resource two static routes and three routes with parameters,
+ * 100 routes in total.
+ */
+std::vector<std::string> apiRoutes()
+{
+    std::vector<std::string> routes;
+    for (const char *resource : API_RESOURCES)
+    {
+        const std::string base = std::string("/api/v1/") + resource;
+        routes.push_back(base);
+        routes.push_back(base + "/count");
+        routes.push_back(base + "/:id");
+        routes.push_back(base + "/:id/history");
+        routes.push_back(base + "/:id/items/:item(\\d+)");
+    }
+    return routes;
+}
+
+void addApiRoutes(BenchRouter &router)
+{
+    const std::vector<std::string> routes = apiRoutes();
+    for (const std::string &route : routes)
+    {
+        router.add("GET", route, [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+            ++res.handled;
+        });
+    }
+}
+
+void benchStaticRoutes()
+{
+    BenchRouter router;
+    addApiRoutes(router);
+
+    std::vector<PathMatcher> matchers;
+    const std::vector<std::string> routes = apiRoutes();
+    for (const std::string &route : routes)
+        matchers.push_back(PathMatcher(parsePath(route)));
+    std::vector<std::size_t> captures(16);
+
+    const char *paths[] = {
+        "/api/v1/users", "/api/v1/settings/count", "/api/v1/settings/42/history"
+    };
+    const std::size_t ops = 100000;
+
+    for (const char *p : paths)
+    {
+        const std::string path = p;
+        std::size_t hits = 0;
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            for (const PathMatcher &m : matchers)
+            {
+                if (m.match(path.data(), path.data() + path.size(), captures.data()))
+                {
+                    ++hits;
+                    break;
+                }
+            }
+        }
+        std::string name = std::string("linear scan    ") + p;
+        report(name.c_str(), ops, secondsSince(start));
+
+        BenchRequest req = { "GET", path };
+        BenchResponse res = { 0 };
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(req, res);
+        name = std::string("HttpRouter     ") + p;
+        report(name.c_str(), ops, secondsSince(start));
+        sink = hits + res.handled;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Gateway with many services
+// ---------------------------------------------------------------------------
+
+/**
+ * 50 services with 20 routes each, the first path segment names the service.
+ */
+std::vector<std::string> gatewayRoutes()
+{
+    std::vector<std::string> routes;
+    for (int service = 0; service < 50; ++service)
+    {
+        for (int resource = 0; resource < 5; ++resource)
+        {
+            const std::string base = "/svc" + std::to_string(service) + "/" + API_RESOURCES[resource];
+            routes.push_back(base);
+            routes.push_back(base + "/:id");
+            routes.push_back(base + "/:id/history");
+            routes.push_back(base + "/:id/items/:item(\\d+)");
+        }
+    }
+    return routes;
+}
+
+void benchGatewayRoutes()
+{
+    BenchRouter router;
+    std::vector<PathMatcher> matchers;
+    const std::vector<std::string> routes = gatewayRoutes();
+    for (const std::string &route : routes)
+    {
+        matchers.push_back(PathMatcher(parsePath(route)));
+        router.add("GET", route, [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+            ++res.handled;
+        });
+    }
+    std::vector<std::size_t> captures(16);
+
+    const char *paths[] = {
+        "/svc0/users/42", "/svc25/orders/42/history", "/svc49/products/42/items/7", "/unknown/path"
+    };
+    const std::size_t ops = 20000;
+
+    for (const char *p : paths)
+    {
+        const std::string path = p;
+        std::size_t hits = 0;
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            for (const PathMatcher &m : matchers)
+            {
+                if (m.match(path.data(), path.data() + path.size(), captures.data()))
+                {
+                    ++hits;
+                    break;
+                }
+            }
+        }
+        std::string name = std::string("linear scan    ") + p;
+        report(name.c_str(), ops, secondsSince(start));
+
+        BenchRequest req = { "GET", path };
+        BenchResponse res = { 0 };
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(req, res);
+        name = std::string("HttpRouter     ") + p;
+        report(name.c_str(), ops, secondsSince(start));
+        sink = hits + res.handled;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Tables with 10000 routes
+// ---------------------------------------------------------------------------
+
+void runLargeTable(const char *name, const std::vector<std::string> &routes, const std::vector<std::string> &paths)
+{
+    BenchRouter router;
+    for (const std::string &route : routes)
+    {
+        router.add("GET", route, [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+            ++res.handled;
+        });
+    }
+
+    std::vector<BenchRequest> requests;
+    for (const std::string &path : paths)
+        requests.push_back(BenchRequest{ "GET", path });
+    BenchResponse res = { 0 };
+    const std::size_t ops = 20000;
+
+    CacheMissCounter counter;
+    counter.start();
+    Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < ops; ++i)
+        router.handleRequest(requests[i % requests.size()], res);
+    const double seconds = secondsSince(start);
+    const std::uint64_t misses = counter.stop();
+
+    report(name, ops, seconds);
+    if (counter.available())
+        std::printf("%-48s %12.1f cache misses/op\n", name, static_cast<double>(misses) / ops);
+    else
+        std::printf("%-48s %12s cache misses/op\n", name, "n/a");
+    sink = res.handled;
+}
+
+/**
+ * 500 services with 20 routes each and 10000 routes under a common
+ * prefix, requested in random order.
+ */
+void benchLargeTables()
+{
+    std::mt19937 random(42);
+    std::vector<std::string> routes, paths;
+
+    for (int service = 0; service < 500; ++service)
+    {
+        for (int resource = 0; resource < 5; ++resource)
+        {
+            const std::string base = "/svc" + std::to_string(service) + "/" + API_RESOURCES[resource];
+            routes.push_back(base);
+            routes.push_back(base + "/:id");
+            routes.push_back(base + "/:id/history");
+            routes.push_back(base + "/:id/items/:item(\\d+)");
+        }
+    }
+    for (int i = 0; i < 4096; ++i)
+    {
+        paths.push_back("/svc" + std::to_string(random() % 500) + "/" + API_RESOURCES[random() % 5] +
+                        "/42/items/" + std::to_string(random() % 100));
+    }
+    runLargeTable("500 services x 20 routes", routes, paths);
+
+    routes.clear();
+    paths.clear();
+    for (int i = 0; i < 10000; ++i)
+        routes.push_back("/api/resource" + std::to_string(i) + "/:id");
+    for (int i = 0; i < 4096; ++i)
+        paths.push_back("/api/resource" + std::to_string(random() % 10000) + "/42");
+    runLargeTable("10000 routes with a common prefix", routes, paths);
+}
+
+// ---------------------------------------------------------------------------
+// Requests of scanners which match no route
+// ---------------------------------------------------------------------------
+
+void benchNotFound()
+{
+    BenchRouter router;
+    for (int i = 0; i < 10000; ++i)
+    {
+        router.add("GET", "/api/resource" + std::to_string(i) + "/:id", [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+            ++res.handled;
+        });
+    }
+    router.add("*", "*", [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+        ++res.handled;
+    });
+
+    // Probes for well-known files, repeated by many scanners.
+    std::vector<BenchRequest> requests;
+    const char *probes[] = { "/wp-login.php", "/.env", "/admin/config.php", "/.git/config" };
+    for (int i = 0; i < 64; ++i)
+    {
+        for (const char *probe : probes)
+            requests.push_back(BenchRequest{ "GET", "/api/v" + std::to_string(i) + probe });
+    }
+    const std::size_t ops = 20000;
+
+    // A copy is a second router whose requests alternate with the first.
+    BenchRouter other(router);
+    const std::size_t sizes[] = { 0, 1024 };
+    for (std::size_t size : sizes)
+    {
+        router.setNegativeCacheSize(size);
+        other.setNegativeCacheSize(size);
+        for (std::size_t count = 1; count <= 2; ++count)
+        {
+            BenchRouter *routers[] = { &router, &other };
+            BenchResponse res = { 0 };
+            for (BenchRequest &req : requests)
+            {
+                for (std::size_t r = 0; r < count; ++r)
+                    routers[r]->handleRequest(req, res);
+            }
+            Clock::time_point start = Clock::now();
+            for (std::size_t i = 0; i < ops; ++i)
+                routers[i % count]->handleRequest(requests[i % requests.size()], res);
+            std::string name = size == 0 ? "without negative cache" : "negative cache, 1024 entries";
+            if (count == 2)
+                name += ", 2 routers in turn";
+            report(name.c_str(), ops, secondsSince(start));
+            sink = res.handled;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Batches of pipelined requests
+// ---------------------------------------------------------------------------
+
+void benchBatches()
+{
+    std::mt19937 random(7);
+    BenchRouter router;
+    for (int service = 0; service < 500; ++service)
+    {
+        for (int resource = 0; resource < 5; ++resource)
+        {
+            const std::string base = "/svc" + std::to_string(service) + "/" + API_RESOURCES[resource];
+            router.add("GET", base, [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+                ++res.handled;
+            });
+            router.add("GET", base + "/:id", [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+                ++res.handled;
+            });
+        }
+    }
+
+    std::vector<BenchRequest> requests;
+    std::vector<std::string> paths;
+    for (int i = 0; i < 4096; ++i)
+    {
+        std::string path = "/svc" + std::to_string(random() % 500) + "/" + API_RESOURCES[random() % 5];
+        if (random() % 2)
+            path += "/" + std::to_string(random() % 1000);
+        requests.push_back(BenchRequest{ "GET", path });
+        paths.push_back(path);
+    }
+    std::vector<BenchResponse> responses(requests.size(), BenchResponse{ 0 });
+    std::vector<std::size_t> routes;
+    std::vector<std::string> single(1);
+    std::size_t hits = 0;
+
+    // Best of 5 rounds, each variant in turn, after a warm-up round.
+    const std::size_t batchSizes[] = { 1, 16, 64 };
+    double handleSeconds[3] = { 1e9, 1e9, 1e9 };
+    double matchSeconds[2] = { 1e9, 1e9 };
+    for (int round = 0; round < 6; ++round)
+    {
+        for (std::size_t b = 0; b < 3; ++b)
+        {
+            Clock::time_point start = Clock::now();
+            if (batchSizes[b] == 1)
+            {
+                for (std::size_t i = 0; i < requests.size(); ++i)
+                    router.handleRequest(requests[i], responses[i]);
+            }
+            else
+            {
+                for (std::size_t i = 0; i < requests.size(); i += batchSizes[b])
+                    router.handleRequests(requests.begin() + i, requests.begin() + i + batchSizes[b], responses.begin() + i);
+            }
+            if (round > 0)
+                handleSeconds[b] = std::min(handleSeconds[b], secondsSince(start));
+        }
+
+        Clock::time_point start = Clock::now();
+        for (const std::string &path : paths)
+        {
+            single[0] = path;
+            router.matchBatch("GET", single, routes);
+            hits += routes[0];
+        }
+        if (round > 0)
+            matchSeconds[0] = std::min(matchSeconds[0], secondsSince(start));
+
+        start = Clock::now();
+        router.matchBatch("GET", paths, routes);
+        hits += routes[0];
+        if (round > 0)
+            matchSeconds[1] = std::min(matchSeconds[1], secondsSince(start));
+    }
+
+    const std::size_t ops = requests.size();
+    report("handleRequest, one at a time", ops, handleSeconds[0]);
+    report("handleRequests, batches of 16", ops, handleSeconds[1]);
+    report("handleRequests, batches of 64", ops, handleSeconds[2]);
+    report("matchBatch, one path at a time", ops, matchSeconds[0]);
+    report("matchBatch, all paths", ops, matchSeconds[1]);
+    sink = hits + responses[0].handled;
+}
+
+// ---------------------------------------------------------------------------
+// Path segmentation
+// ---------------------------------------------------------------------------
+
+void benchSplitPath()
+{
+    const std::string paths[] = {
+        "/api/v1/users/42",
+        "/api/v1/organizations/acme-corporation/repositories/router/issues/1234",
+        "/static/" + std::string(240, 'a') + "/" + std::string(240, 'b') + "/c/d/e/f/index.html"
+    };
+    const std::size_t ops = 2000000;
+    std::size_t total = 0;
+
+    for (const std::string &path : paths)
+    {
+        std::printf("%zu bytes\n", path.size());
+
+        // Byte by byte into a fixed array, as a handler would do it.
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            std::uint32_t offsets[PathSegments::MAX_DELIMITERS];
+            std::size_t count = 0;
+            for (const char *p = path.data(), *e = p + path.size(); p != e && count < PathSegments::MAX_DELIMITERS; ++p)
+            {
+                if (*p == '/')
+                    offsets[count++] = static_cast<std::uint32_t>(p - path.data());
+            }
+            total += count + offsets[count - 1];
+        }
+        report("  scalar loop", ops, secondsSince(start));
+
+        PathSegments segments;
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            splitPath(path.data(), path.data() + path.size(), segments);
+            total += segments.size() + segments.delimiter(0);
+        }
+        report("  splitPath", ops, secondsSince(start));
+    }
+    sink = total;
+}
+
+// ---------------------------------------------------------------------------
+// One path for several methods
+// ---------------------------------------------------------------------------
+
+void benchSharedRoutes()
+{
+    const char *methods[] = { "GET", "PUT", "PATCH", "DELETE" };
+    const int resources = 1000;
+    BenchRouter::Handler handler = [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+        ++res.handled;
+    };
+
+    std::vector<BenchRequest> requests;
+    for (int i = 0; i < 64; ++i)
+    {
+        const std::string path = "/api/resource" + std::to_string(i * 15) + "/items/" + std::to_string(i);
+        requests.push_back(BenchRequest{ methods[i % 4], path });
+    }
+    const std::size_t ops = 200000;
+
+    for (int shared = 0; shared < 2; ++shared)
+    {
+        BenchRouter router;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < resources; ++i)
+        {
+            const std::string path = "/api/resource" + std::to_string(i) + "/items/:id";
+            if (shared)
+                router.route(path).get(handler).put(handler).patch(handler).del(handler);
+            else
+            {
+                for (const char *method : methods)
+                    router.add(method, path, handler);
+            }
+        }
+        const double seconds = secondsSince(start);
+        std::printf("%-48s %12.1f us/path %8zu routes\n", shared ? "register with route()" : "register with add() per method",
+                    seconds * 1e6 / resources, router.routeCount());
+
+        BenchResponse res = { 0 };
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(requests[i % requests.size()], res);
+        report("  route", ops, secondsSince(start));
+        sink = res.handled;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Allowed methods of a path
+// ---------------------------------------------------------------------------
+
+void benchAllowedMethods()
+{
+    BenchRouter router;
+    BenchRouter::Handler handler = [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+        ++res.handled;
+    };
+    const char *methods[] = { "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH" };
+    for (int i = 0; i < 100; ++i)
+    {
+        const std::string path = "/api/resource" + std::to_string(i) + "/items/:id(\\d+)";
+        router.add("GET", path, handler);
+        router.add("PUT", path, handler);
+        router.add("DELETE", path, handler);
+        router.add("GET", "/api/resource" + std::to_string(i) + "/items/:name", handler);
+    }
+    const std::vector<std::string> paths({ "/api/resource50/items/12345" });
+    const std::size_t ops = 100000;
+
+    // Without method sets every method is tried in turn.
+    std::vector<std::size_t> routes;
+    std::uint32_t allowed = 0;
+    Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < ops; ++i)
+    {
+        for (std::size_t m = 0; m < sizeof(methods) / sizeof(methods[0]); ++m)
+        {
+            router.matchBatch(methods[m], paths, routes);
+            if (routes[0] != BenchRouter::NO_ROUTE)
+                allowed |= 1u << m;
+        }
+    }
+    report("matchBatch per method", ops, secondsSince(start));
+
+    start = Clock::now();
+    for (std::size_t i = 0; i < ops; ++i)
+        allowed += router.allowedMethods(paths[0]);
+    report("allowedMethods", ops, secondsSince(start));
+    sink = allowed;
+}
+
+// ---------------------------------------------------------------------------
+// Prefix middleware and mounted routers
+// ---------------------------------------------------------------------------
+
+void benchMounts()
+{
+    BenchRouter::Handler handler = [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+        ++res.handled;
+    };
+    BenchRouter::Handler middleware = [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+        ++res.handled;
+        ctx.next();
+    };
+    const int services = 20, resources = 20;
+    std::vector<BenchRequest> requests;
+    for (int i = 0; i < 64; ++i)
+    {
+        requests.push_back(BenchRequest{ "GET", "/svc" + std::to_string(i * 7 % services) + "/resource" +
+                                                std::to_string(i % resources) + "/" + std::to_string(i) });
+    }
+    const std::size_t ops = 200000;
+
+    for (int variant = 0; variant < 3; ++variant)
+    {
+        BenchRouter router;
+        std::vector<BenchRouter> subRouters(services);
+        for (int s = 0; s < services; ++s)
+        {
+            const std::string prefix = "/svc" + std::to_string(s);
+            if (variant == 0)
+                router.add("*", prefix + "/*", middleware);
+            else
+                router.use(prefix, middleware);
+            for (int r = 0; r < resources; ++r)
+            {
+                const std::string path = "/resource" + std::to_string(r) + "/:id";
+                if (variant == 2)
+                    subRouters[s].add("GET", path, handler);
+                else
+                    router.add("GET", prefix + path, handler);
+            }
+            if (variant == 2)
+                router.mount(prefix, subRouters[s]);
+        }
+
+        BenchResponse res = { 0 };
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(requests[i % requests.size()], res);
+        const char *names[] = { "middleware on /svc/*, flat routes", "middleware with use(), flat routes",
+                                "middleware with use(), mounted routers" };
+        report(names[variant], ops, secondsSince(start));
+        sink = res.handled;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Per-route options
+// ---------------------------------------------------------------------------
+
+void benchRouteOptions()
+{
+    BenchRouter::Handler handler = [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+        ++res.handled;
+    };
+    const int count = 100;
+    std::vector<BenchRequest> staticRequests, dynamicRequests;
+    for (int i = 0; i < 64; ++i)
+    {
+        staticRequests.push_back(BenchRequest{ "GET", "/pages/page" + std::to_string(i * 7 % count) });
+        dynamicRequests.push_back(BenchRequest{ "GET", "/items" + std::to_string(i * 7 % count) + "/" + std::to_string(i) });
+    }
+    const std::size_t ops = 500000;
+
+    for (int variant = 0; variant < 2; ++variant)
+    {
+        BenchRouter router;
+        if (variant == 1)
+            router.setDefaultOptions(PR_SENSITIVE | PR_STRICT | PR_END);
+        for (int i = 0; i < count; ++i)
+        {
+            router.add("GET", "/pages/page" + std::to_string(i), handler);
+            router.add("GET", "/items" + std::to_string(i) + "/:id", handler);
+        }
+
+        const char *names[] = { "default options", "PR_SENSITIVE | PR_STRICT | PR_END" };
+        BenchResponse res = { 0 };
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(staticRequests[i % staticRequests.size()], res);
+        report((std::string(names[variant]) + ", static routes").c_str(), ops, secondsSince(start));
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(dynamicRequests[i % dynamicRequests.size()], res);
+        report((std::string(names[variant]) + ", routes with a key").c_str(), ops, secondsSince(start));
+        sink = res.handled;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Legacy aliases of a route
+// ---------------------------------------------------------------------------
+
+void benchAliasRoutes()
+{
+    std::vector<std::string> aliases;
+    for (int i = 0; i < 200; ++i)
+    {
+        aliases.push_back("/legacy" + std::to_string(i) + "/item");
+        aliases.push_back("/legacy" + std::to_string(i) + "/item/:id");
+    }
+    std::vector<std::string> paths;
+    for (int i = 0; i < 64; ++i)
+        paths.push_back("/legacy" + std::to_string(i * 7 % 200) + (i % 2 ? "/item/42" : "/item"));
+    const std::size_t ops = 20000;
+
+    // One alternation of all aliases, as combined by pathToRegexp(first, last).
+    const std::regex combined = to_regex(pathToRegexp(aliases.begin(), aliases.end()));
+    std::size_t hits = 0;
+    Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < ops; ++i)
+    {
+        const std::string &path = paths[i % paths.size()];
+        std::smatch m;
+        if (std::regex_search(path, m, combined))
+            ++hits;
+    }
+    report("combined std::regex", ops, secondsSince(start));
+
+    BenchRouter router;
+    router.add("GET", aliases.begin(), aliases.end(),
+               [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+                   res.handled += ctx.alternative();
+               });
+    BenchResponse res = { 0 };
+    start = Clock::now();
+    for (std::size_t i = 0; i < ops; ++i)
+    {
+        BenchRequest req = { "GET", paths[i % paths.size()] };
+        router.handleRequest(req, res);
+    }
+    report("HttpRouter multi-path route", ops, secondsSince(start));
+    sink = hits + res.handled;
+}
+
+// ---------------------------------------------------------------------------
+// Typed route parameters
+// ---------------------------------------------------------------------------
+
+void benchTypedParams()
+{
+    std::vector<BenchRequest> requests;
+    for (int i = 0; i < 64; ++i)
+        requests.push_back(BenchRequest{ "GET", "/orders/" + std::to_string(1000000007LL * (i + 1)) });
+    const std::size_t ops = 500000;
+
+    for (int variant = 0; variant < 3; ++variant)
+    {
+        BenchRouter router;
+        std::int64_t total = 0;
+        if (variant == 0)
+        {
+            router.add("GET", "/orders/:id", [&total](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+                total += std::stoll(ctx.match(1));
+            });
+        }
+        else
+        {
+            router.add("GET", variant == 1 ? "/orders/:id" : "/orders/:id(\\d+)",
+                       [&total](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+                           total += ctx.param<std::int64_t>("id");
+                       });
+        }
+
+        const char *names[] = { "std::stoll(ctx.match(1))", "ctx.param<int64_t>, any pattern",
+                                "ctx.param<int64_t>, pattern \\d+" };
+        BenchResponse res = { 0 };
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(requests[i % requests.size()], res);
+        report(names[variant], ops, secondsSince(start));
+        sink = static_cast<std::size_t>(total);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Parameter hooks
+// ---------------------------------------------------------------------------
+
+void benchParamHooks()
+{
+    // The lookup of the account, e.g. in a database, is the expensive part.
+    std::map<std::string, std::string> accounts;
+    for (int i = 0; i < 1000; ++i)
+        accounts["acct-" + std::to_string(i)] = "owner " + std::to_string(i);
+    std::vector<BenchRequest> requests;
+    for (int i = 0; i < 64; ++i)
+        requests.push_back(BenchRequest{ "GET", "/accounts/acct-" + std::to_string(i * 13 % 1000) + "/orders" });
+    const std::size_t ops = 200000;
+    const int middlewares = 3;
+
+    for (int variant = 0; variant < 2; ++variant)
+    {
+        BenchRouter router;
+        router.param<std::string>("accountId", [&accounts](BenchRouter::Context &ctx, StringRef id) {
+            return accounts.at(id.to_string());
+        });
+        for (int i = 0; i < middlewares; ++i)
+        {
+            router.use("/accounts/:accountId", [&accounts, variant](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+                if (variant == 0)
+                    res.handled += accounts.at(ctx.param("accountId").to_string()).size();
+                else
+                    res.handled += ctx.load<std::string>("accountId").size();
+                ctx.next();
+            });
+        }
+        router.add("GET", "/accounts/:accountId/orders", [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+            ++res.handled;
+        });
+
+        BenchResponse res = { 0 };
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(requests[i % requests.size()], res);
+        report(variant == 0 ? "lookup in every middleware" : "ctx.load<T>, once per request", ops, secondsSince(start));
+        sink = res.handled;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Cached middleware chains
+// ---------------------------------------------------------------------------
+
+void benchMiddlewareChains()
+{
+    BenchRouter::Handler middleware = [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+        ++res.handled;
+        ctx.next();
+    };
+    BenchRouter::Handler handler = [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+        res.handled += ctx.rawParam(2).size();
+    };
+    std::vector<BenchRequest> repeated, unique;
+    for (int i = 0; i < 64; ++i)
+        repeated.push_back(BenchRequest{ "GET", "/user/" + std::to_string(i) + "/posts/p" + std::to_string(i % 7) });
+    const std::size_t ops = 200000;
+    for (std::size_t i = 0; i < ops; ++i)
+        unique.push_back(BenchRequest{ "GET", "/user/" + std::to_string(i) + "/posts/p" + std::to_string(i % 7) });
+
+    for (int cached = 0; cached < 2; ++cached)
+    {
+        BenchRouter router;
+        router.setChainCacheSize(cached ? 1024 : 0);
+        router.use("/user", middleware);
+        router.use("/user/:id(\\d+)", middleware);
+        for (int i = 0; i < 10; ++i)
+            router.add("GET", "/user/:id(\\d+)/items" + std::to_string(i) + "/:item", handler);
+        router.add("GET", "/user/:id(\\d+)/posts/:post([a-z]\\w*)", handler);
+
+        BenchResponse res = { 0 };
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(repeated[i % repeated.size()], res);
+        report(cached ? "chain cache, 64 paths" : "no chain cache, 64 paths", ops, secondsSince(start));
+        // A copy is a second router whose requests alternate with the first.
+        BenchRouter other(router);
+        BenchRouter *routers[] = { &router, &other };
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            routers[i % 2]->handleRequest(repeated[i / 2 % repeated.size()], res);
+        report(cached ? "chain cache, 64 paths, 2 routers in turn" : "no chain cache, 64 paths, 2 routers in turn",
+               ops, secondsSince(start));
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(unique[i], res);
+        report(cached ? "chain cache, unique paths" : "no chain cache, unique paths", ops, secondsSince(start));
+        sink = res.handled;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Heap allocations per request
+// ---------------------------------------------------------------------------
+
+void benchAllocations()
+{
+    BenchRouter router;
+    BenchRouter::Handler handler = [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+        res.handled += ctx.param(0).size() + ctx.query("fields").size();
+    };
+    router.add("GET", "/api/health", handler);
+    router.add("GET", "/api/users/:id/posts/:post", handler);
+    router.add("GET", "/api/files/:path(.*\\.png)", handler);
+    router.add("GET", "/api/tags/:tag(\\w+\\b-\\w+)", handler);
+    router.add("*", "*", handler);
+
+    const struct
+    {
+        const char *name;
+        const char *path;
+    } cases[] = {
+        { "static route", "/api/health" },
+        { "native route", "/api/users/12345/posts/678?fields=title" },
+        { "VM route", "/api/files/images/logo.png" },
+        { "std::regex route", "/api/tags/abc-def" },
+        { "catch-all", "/wp-login.php" }
+    };
+    const std::size_t ops = 200000;
+
+    for (const auto &c : cases)
+    {
+        BenchRequest req = { "GET", c.path };
+        BenchResponse res = { 0 };
+        router.handleRequest(req, res);
+
+        // BenchRequest returns the URI by value, that copy is counted too.
+        const std::size_t before = heapAllocations;
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(req, res);
+        const double seconds = secondsSince(start);
+        const std::size_t allocations = heapAllocations - before;
+        std::printf("%-48s %12.1f ns/op %10.2f allocations/op\n", c.name,
+                    seconds * 1e9 / ops, static_cast<double>(allocations) / ops);
+        sink = res.handled;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Path normalization
+// ---------------------------------------------------------------------------
+
+/** Normalization as handlers typically do it, one step and one string at a time */
+std::string normalizeBySteps(const std::string &path)
+{
+    std::string decoded;
+    for (std::size_t i = 0; i < path.size(); ++i)
+    {
+        if (path[i] == '%' && i + 2 < path.size() && std::isxdigit(path[i + 1]) && std::isxdigit(path[i + 2]))
+        {
+            const char c = static_cast<char>(std::stoi(path.substr(i + 1, 2), 0, 16));
+            if (std::isalnum(static_cast<unsigned char>(c)) || std::strchr("-._~", c))
+            {
+                decoded += c;
+                i += 2;
+                continue;
+            }
+        }
+        decoded += path[i];
+    }
+
+    std::vector<std::string> segments;
+    std::size_t begin = 1;
+    for (std::size_t end; begin <= decoded.size(); begin = end + 1)
+    {
+        end = std::min(decoded.find('/', begin), decoded.size());
+        const std::string segment = decoded.substr(begin, end - begin);
+        if (segment == "..")
+        {
+            if (!segments.empty())
+                segments.pop_back();
+        }
+        else if (!segment.empty() && segment != ".")
+            segments.push_back(segment);
+    }
+
+    std::string result;
+    for (const std::string &segment : segments)
+        result += "/" + segment;
+    return result.empty() ? "/" : result;
+}
+
+void benchNormalizePath()
+{
+    const std::string paths[] = {
+        "/api/v1/users/42",
+        "//api/v1/./users/%7Ealice/../42/",
+        "/static/" + std::string(240, 'a') + "//./" + std::string(240, 'b') + "/../c/d/e/f/index.html"
+    };
+    const std::size_t ops = 1000000;
+    std::size_t total = 0;
+
+    for (const std::string &path : paths)
+    {
+        std::printf("%zu bytes\n", path.size());
+
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            total += normalizeBySteps(path).size();
+        report("  step by step", ops, secondsSince(start));
+
+        std::string buffer(path);
+        start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            total += normalizePath(path.data(), path.data() + path.size(), &buffer[0]) - buffer.data();
+        report("  normalizePath", ops, secondsSince(start));
+    }
+
+    // Overhead of the normalization stage for requests with canonical paths.
+    BenchRouter router;
+    for (int i = 0; i < 100; ++i)
+    {
+        router.add("GET", "/api/resource" + std::to_string(i) + "/:id", [](BenchRequest &req, BenchResponse &res, BenchRouter::Context &ctx) {
+            ++res.handled;
+        });
+    }
+    BenchRequest req = { "GET", "/api/resource50/12345?fields=name" };
+    BenchResponse res = { 0 };
+    const int options[] = { 0, NP_ALL };
+    for (int option : options)
+    {
+        router.setPathNormalization(option);
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i)
+            router.handleRequest(req, res);
+        report(option == 0 ? "route without normalization" : "route with normalization", ops, secondsSince(start));
+    }
+    sink = total + res.handled;
+}
+
+struct Benchmark
+{
+    const char *name;
+    void (*run)();
+};
+
+const Benchmark BENCHMARKS[] = {
+    { "pathfunction-threads", benchPathFunctionThreads },
+    { "pathfunction-validate", benchPathFunctionValidate },
+    { "encode-uri-component", benchEncodeURIComponent },
+    { "decode-uri-component", benchDecodeURIComponent },
+    { "adversarial-paths", benchAdversarialPaths },
+    { "case-folding", benchCaseFolding },
+    { "static-routes", benchStaticRoutes },
+    { "gateway-routes", benchGatewayRoutes },
+    { "large-tables", benchLargeTables },
+    { "not-found", benchNotFound },
+    { "batches", benchBatches },
+    { "split-path", benchSplitPath },
+    { "normalize-path", benchNormalizePath },
+    { "allocations", benchAllocations },
+    { "shared-routes", benchSharedRoutes },
+    { "allowed-methods", benchAllowedMethods },
+    { "mounts", benchMounts },
+    { "route-options", benchRouteOptions },
+    { "alias-routes", benchAliasRoutes },
+    { "typed-params", benchTypedParams },
+    { "param-hooks", benchParamHooks },
+    { "middleware-chains", benchMiddlewareChains }
+};
+
+} // unnamed namespace
+
+int main(int argc, char **argv)
+{
+    // Without arguments all benchmarks are run, otherwise only those named.
+    for (const Benchmark &b : BENCHMARKS)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], b.name) == 0)
+                selected = true;
+        }
+        if (selected)
+        {
+            std::printf("== %s\n", b.name);
+            b.run();
+        }
+    }
+    return 0;
+}
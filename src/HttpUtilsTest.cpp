@@ -7,8 +7,15 @@
 #define CATCH_CONFIG_MAIN
 #include "PathToRegexp.hpp"
 #include "HttpRouter.hpp"
+#include "UriUtils.hpp"
+#include "RouteTable.hpp"
+#include "MonotonicBuffer.hpp"
+#include "ParamTraits.hpp"
+#include "NegativeCache.hpp"
+#include "CacheSet.hpp"
 #include "catch.hpp"
 #include <sstream>
+#include <memory>
 
 using namespace HttpUtils;
 
@@ -70,6 +77,427 @@ TEST_CASE("Convert tokens to regular expression", "[tokensToRegExp]") {
     REQUIRE_THROWS_AS(pf(sm), std::logic_error);
 }
 
+TEST_CASE("Evaluate shared const path function", "[compilePath]") {
+
+    const PathFunction pf = compilePath("/user/:id(\\d+)/:name");
+    const PathFunction copy = pf;
+    SegmentMap sm;
+    sm["id"] = {"42"};
+    sm["name"] = {"a b"};
+    REQUIRE(pf(sm) == "/user/42/a+b");
+    REQUIRE(copy(sm) == "/user/42/a+b");
+    sm["id"] = {"x"};
+    REQUIRE_THROWS_AS(copy(sm), std::logic_error);
+
+    const PathFunction trusted = compilePath("/user/:id(\\d+)", PF_TRUSTED_INPUT);
+    REQUIRE(trusted(sm) == "/user/x");
+}
+
+TEST_CASE("Validate values against key patterns", "[PathValidator]") {
+
+    PathValidator segment("[^\\/]+?");
+    REQUIRE(segment.kind() == PathValidator::PV_CHAR_RUN);
+    REQUIRE(segment("abc"));
+    REQUIRE_FALSE(segment(""));
+    REQUIRE_FALSE(segment("a/b"));
+
+    PathValidator digits("\\d+");
+    REQUIRE(digits.kind() == PathValidator::PV_CHAR_RUN);
+    REQUIRE(digits("0123"));
+    REQUIRE_FALSE(digits("12a"));
+
+    PathValidator hex("[0-9a-fA-F]*");
+    REQUIRE(hex.kind() == PathValidator::PV_CHAR_RUN);
+    REQUIRE(hex(""));
+    REQUIRE(hex("dEadBeef"));
+    REQUIRE_FALSE(hex("xyz"));
+
+    PathValidator any(".*");
+    REQUIRE(any.kind() == PathValidator::PV_CHAR_RUN);
+    REQUIRE(any("%2Fanything"));
+
+    PathValidator types("video|audio|text");
+    REQUIRE(types.kind() == PathValidator::PV_ALTERNATION);
+    REQUIRE(types("audio"));
+    REQUIRE_FALSE(types("xaudiox"));
+    REQUIRE_FALSE(types("aud"));
+
+    PathValidator complex("\\+.+");
+    REQUIRE(complex.kind() == PathValidator::PV_REGEX);
+    REQUIRE(complex("+json"));
+    REQUIRE_FALSE(complex("json"));
+}
+
+TEST_CASE("Repeat keys with an alternation like std::regex", "[PathMatcher]") {
+    // The alternation of the pattern extends over the repetition in tokensToRegExp().
+    const char *routes[] = { "/:x(a|b|c)+", "/:x(a|b|c)*", "/p/:x(ab|a)+" };
+    const char *paths[] = {
+        "/a", "/c", "/a/b", "/b/c", "/c/a", "/c/b", "/a/b/c", "/a/c/b", "/c/a/b", "/d", "/p/a/ab", "/p/ab/a", "/p/abab"
+    };
+    for (const char *route : routes)
+    {
+        const std::vector<PathToken> tokens = parsePath(route);
+        const PathMatcher matcher(tokens, PR_END);
+        REQUIRE(matcher.supported());
+        const std::regex re = to_regex(tokensToRegExp(tokens, PR_END));
+        std::vector<std::size_t> captures(matcher.captureSize());
+        for (const char *path : paths)
+        {
+            const std::string p(path);
+            std::smatch m;
+            const bool expected = std::regex_search(p, m, re);
+            INFO(route << " " << path);
+            REQUIRE(matcher.match(p.data(), p.data() + p.size(), captures.data()) == expected);
+            if (expected && m[1].matched)
+            {
+                REQUIRE(captures[2] == static_cast<std::size_t>(m.position(1)));
+                REQUIRE(captures[3] == static_cast<std::size_t>(m.position(1) + m.length(1)));
+            }
+        }
+    }
+}
+
+TEST_CASE("Match routes in linear time", "[PathMatcher]") {
+
+    const char *routes[] = {
+        "/user/:id(\\d+)", "/user/:str", "/user/*", "*", "/:test/",
+        "/:postType(video|audio|text)(\\+.+)?", "/files/:dir/:name?",
+        "/:segment+", "/:segment*/end", "/a/b/:c([a-z]{2,3})", "/:x(a*?b|c)",
+        "/user/:id(\\d+)/posts/:post", "/:postType(video|audio|text)", "/a/:b(\\w*)/",
+        "/a/:rest(.*?)", "/:all([\\w/]+)"
+    };
+    const char *paths[] = {
+        "", "/", "/user/123", "/user/uid123", "/USER/123/", "/user/123/more",
+        "/video", "/audio+json", "/text+", "/files/docs", "/files/docs/a.pdf",
+        "/files/docs/", "/a/b/c/end", "/end", "//end", "/a/b/xy", "/a/b/xyzw",
+        "/aaab", "/c", "/test/", "/test//", "/user/12/posts/Hello", "/USER/12/Posts/x/",
+        "/user//posts/x", "/AUDIO", "/a//", "/a/x_1/", "/a/x_1/y"
+    };
+    const int options[] = { PR_END, PR_SENSITIVE|PR_STRICT|PR_END, PR_SENSITIVE|PR_STRICT, 0 };
+    // Scratch memory shared by all matchers
+    PathMatcher::State state;
+
+    for (const char *route : routes)
+    {
+        for (int opts : options)
+        {
+            const std::vector<PathToken> tokens = parsePath(route);
+            const PathMatcher matcher(tokens, opts);
+            REQUIRE(matcher.supported());
+            const std::regex re = to_regex(tokensToRegExp(tokens, opts));
+            std::vector<std::size_t> captures(matcher.captureSize());
+
+            for (const char *path : paths)
+            {
+                const std::string p(path);
+                std::smatch m;
+                const bool expected = std::regex_search(p, m, re);
+                INFO(route << " " << opts << " " << path);
+                REQUIRE(matcher.match(p.data(), p.data() + p.size(), captures.data()) == expected);
+                std::vector<std::size_t> stateCaptures(matcher.captureSize());
+                REQUIRE(matcher.match(p.data(), p.data() + p.size(), stateCaptures.data(), state) == expected);
+                if (expected)
+                    REQUIRE(stateCaptures == captures);
+                if (!matcher.caseSensitive())
+                {
+                    std::string lower(p);
+                    asciiToLower(p.data(), p.data() + p.size(), &lower[0]);
+                    std::vector<std::size_t> lowerCaptures(matcher.captureSize());
+                    REQUIRE(matcher.matchLowercase(lower.data(), lower.data() + lower.size(), lowerCaptures.data()) == expected);
+                    if (expected)
+                        REQUIRE(lowerCaptures == captures);
+                }
+                if (!expected)
+                    continue;
+                REQUIRE(m.size() * 2 == captures.size());
+                for (std::size_t i = 0; i < m.size(); ++i)
+                {
+                    REQUIRE((captures[2 * i] != PathMatcher::npos) == m[i].matched);
+                    if (m[i].matched)
+                        REQUIRE(p.substr(captures[2 * i], captures[2 * i + 1] - captures[2 * i]) == m[i].str());
+                }
+            }
+        }
+    }
+
+    REQUIRE_FALSE(PathMatcher(parsePath("/:x(a\\1)")).supported());
+    REQUIRE_FALSE(PathMatcher(parsePath("/:x(a\\b)")).supported());
+
+    // Inputs that make a backtracking engine explode or overflow its stack.
+    const PathMatcher nested(parsePath("/:word(\\w+\\w+\\w+)\\.json"));
+    const std::string adversarial = "/" + std::string(100000, 'a') + "!";
+    std::vector<std::size_t> captures(nested.captureSize());
+    REQUIRE_FALSE(nested.match(adversarial.data(), adversarial.data() + adversarial.size(), captures.data()));
+    const std::string json = "/" + std::string(100000, 'a') + ".json";
+    REQUIRE(nested.match(json.data(), json.data() + json.size(), captures.data()));
+    REQUIRE(captures[3] - captures[2] == 100000);
+}
+
+TEST_CASE("Analyze route cost", "[analyzeRoute]") {
+
+    REQUIRE(analyzeRoute(parsePath("/user/:id(\\d+)/posts/:post")).routeClass == RC_NATIVE);
+    REQUIRE(analyzeRoute(parsePath("/:postType(video|audio|text)")).routeClass == RC_NATIVE);
+    // Ambiguous end of the key: "x" is a prefix of "xy", "." is part of the name.
+    REQUIRE(analyzeRoute(parsePath("/:a(x|xy)")).routeClass == RC_LINEAR);
+    REQUIRE(analyzeRoute(parsePath("/:name.:ext")).routeClass == RC_LINEAR);
+    // Catch-all routes run to the end of the path.
+    REQUIRE(analyzeRoute(parsePath("*")).routeClass == RC_NATIVE);
+    REQUIRE(analyzeRoute(parsePath("/files/*")).routeClass == RC_NATIVE);
+    REQUIRE(analyzeRoute(parsePath("/files/*"), 0).routeClass == RC_LINEAR);
+
+    RouteAnalysis analysis = analyzeRoute(parsePath("/:word(\\w+\\w+\\w+)\\.json"));
+    REQUIRE(analysis.routeClass == RC_LINEAR);
+    REQUIRE(analysis.degree == 3);
+    REQUIRE(analysis.complexity() == "O(n)");
+
+    analysis = analyzeRoute(parsePath("/:x(\\w+\\b\\w+)"));
+    REQUIRE(analysis.routeClass == RC_BACKTRACKING);
+    REQUIRE(analysis.complexity() == "O(n^2)");
+
+    analysis = analyzeRoute(parsePath("/:x(\\w+\\b)+"));
+    REQUIRE(analysis.routeClass == RC_BACKTRACKING);
+    REQUIRE(analysis.exponential);
+    REQUIRE(analysis.complexity() == "O(2^n)");
+}
+
+TEST_CASE("Encode URI components", "[encodeURIComponent]") {
+
+    REQUIRE(encodeURIComponent("") == "");
+    REQUIRE(encodeURIComponent("abcXYZ019-_.!~*'()") == "abcXYZ019-_.!~*'()");
+    REQUIRE(encodeURIComponent("a b/c?d=e&f") == "a+b%2Fc%3Fd%3De%26f");
+    REQUIRE(encodeURIComponent("\xC3\xA4@[`{\x7F") == "%C3%A4%40%5B%60%7B%7F");
+
+    // Escapes at every position of long runs exercise the SIMD scanners.
+    const std::string run = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    for (std::string::size_type i = 0; i <= run.size(); ++i)
+    {
+        std::string str = run;
+        str.insert(i, "+/=");
+        std::string expected = run;
+        expected.insert(i, "%2B%2F%3D");
+        REQUIRE(encodeURIComponent(str) == expected);
+    }
+
+    std::string all;
+    for (int c = 0; c < 256; ++c)
+        all += static_cast<char>(c);
+    const std::string encoded = encodeURIComponent(all + all);
+    std::string::size_type unescaped = 0;
+    for (std::string::size_type i = 0; i < encoded.size(); ++i)
+    {
+        if (encoded[i] == '%')
+            i += 2;
+        else
+            ++unescaped;
+    }
+    REQUIRE(unescaped == 2 * 72);
+}
+
+TEST_CASE("Decode URI components", "[decodeURIComponent]") {
+
+    REQUIRE(decodeURIComponent("") == "");
+    REQUIRE(decodeURIComponent("plain-value") == "plain-value");
+    REQUIRE(decodeURIComponent("a+b%2Fc%3fd") == "a b/c?d");
+    REQUIRE(decodeURIComponent("100%") == "100%");
+    REQUIRE(decodeURIComponent("%zz%4") == "%zz%4");
+
+    std::string all;
+    for (int c = 0; c < 256; ++c)
+        all += static_cast<char>(c);
+    REQUIRE(decodeURIComponent(encodeURIComponent(all + all)) == all + all);
+
+    const std::string run = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    REQUIRE(findURIEscape(run.data(), run.data() + run.size()) == run.data() + run.size());
+    for (std::string::size_type i = 0; i < run.size(); ++i)
+    {
+        std::string str = run;
+        str[i] = '%';
+        REQUIRE(findURIEscape(str.data(), str.data() + str.size()) == str.data() + i);
+        str[i] = '+';
+        REQUIRE(findURIEscape(str.data(), str.data() + str.size()) == str.data() + i);
+    }
+}
+
+TEST_CASE("Convert ASCII to lower case", "[asciiToLower]") {
+
+    std::string all;
+    for (int i = 0; i < 3; ++i)
+        for (int c = 0; c < 256; ++c)
+            all += static_cast<char>(c);
+
+    std::string expected = all;
+    for (std::string::size_type i = 0; i < expected.size(); ++i)
+    {
+        if (expected[i] >= 'A' && expected[i] <= 'Z')
+            expected[i] += 'a' - 'A';
+    }
+
+    // Every length exercises the vector loops and the scalar tail.
+    for (std::string::size_type n = 0; n <= 100; ++n)
+    {
+        std::string out(n, '\0');
+        REQUIRE(asciiToLower(all.data() + 60, all.data() + 60 + n, &out[0]) == out.data() + n);
+        REQUIRE(out == expected.substr(60, n));
+    }
+    REQUIRE(asciiToLower(&all[0], all.data() + all.size(), &all[0]) == all.data() + all.size());
+    REQUIRE(all == expected);
+}
+
+TEST_CASE("Split paths into segments", "[splitPath]") {
+
+    PathSegments segments;
+    splitPath("/users/5", "/users/5" + 8, segments);
+    REQUIRE(segments.size() == 3);
+    REQUIRE(segments[0] == "");
+    REQUIRE(segments[1] == "users");
+    REQUIRE(segments[2] == "5");
+    REQUIRE(segments.delimiter(1) == 6);
+    REQUIRE(!segments.truncated());
+
+    splitPath("", "", segments);
+    REQUIRE(segments.size() == 1);
+    REQUIRE(segments[0] == "");
+
+    const std::string dotted = "a.b..c";
+    splitPath(dotted.data(), dotted.data() + dotted.size(), segments, '.');
+    REQUIRE(segments.size() == 4);
+    REQUIRE(segments[3] == "c");
+
+    // Every length and delimiter pattern exercises the vector loops and the scalar tail.
+    for (std::string::size_type n = 0; n <= 200; ++n)
+    {
+        std::string path;
+        for (std::string::size_type i = 0; i < n; ++i)
+            path += (i * 7 % 5 == 0) ? '/' : static_cast<char>('a' + i % 26);
+
+        std::vector<std::string> expected(1);
+        for (char c : path)
+        {
+            if (c == '/' && expected.size() <= PathSegments::MAX_DELIMITERS)
+                expected.push_back(std::string());
+            else
+                expected.back() += c;
+        }
+
+        splitPath(path.data(), path.data() + path.size(), segments);
+        INFO(path);
+        REQUIRE(segments.truncated() == (std::count(path.begin(), path.end(), '/') > 31));
+        REQUIRE(segments.size() == expected.size());
+        for (std::size_t i = 0; i < expected.size(); ++i)
+            REQUIRE(segments[i] == expected[i]);
+    }
+}
+
+TEST_CASE("Normalize paths", "[normalizePath]") {
+
+    auto normalize = [](const std::string &path, int options) {
+        std::string result(path);
+        result.resize(normalizePath(path.data(), path.data() + path.size(), &result[0], options) - result.data());
+        return result;
+    };
+
+    REQUIRE(normalize("", NP_ALL) == "");
+    REQUIRE(normalize("/", NP_ALL) == "/");
+    REQUIRE(normalize("/users/5", NP_ALL) == "/users/5");
+    REQUIRE(normalize("//a/./b/../c/", NP_ALL) == "/a/c");
+    REQUIRE(normalize("/a//b///c", NP_ALL) == "/a/b/c");
+    REQUIRE(normalize("/..", NP_ALL) == "/");
+    REQUIRE(normalize("/../../a", NP_ALL) == "/a");
+    REQUIRE(normalize("/a/b/..", NP_ALL) == "/a");
+    REQUIRE(normalize("/a/b/..", NP_RESOLVE_DOTS) == "/a/");
+    REQUIRE(normalize("/a/.b/..c/...", NP_ALL) == "/a/.b/..c/...");
+    REQUIRE(normalize("a/../b/./c", NP_ALL) == "b/c");
+    REQUIRE(normalize("/%7Euser/%41%2f%20", NP_ALL) == "/~user/A%2f%20");
+    REQUIRE(normalize("/a/%2E%2e/b", NP_ALL) == "/b");
+    REQUIRE(normalize("/a/%2E%2e/b", NP_RESOLVE_DOTS) == "/a/%2E%2e/b");
+    REQUIRE(normalize("/a/%4", NP_ALL) == "/a/%4");
+    REQUIRE(normalize("//a//./", NP_COLLAPSE_SLASHES) == "/a/./");
+    REQUIRE(normalize("//a//./", NP_RESOLVE_DOTS) == "//a//");
+    REQUIRE(normalize("/a/", NP_REMOVE_TRAILING_SLASH) == "/a");
+    REQUIRE(normalize("/a/", 0) == "/a/");
+
+    // In place
+    char path[] = "/a/./b//../%63";
+    REQUIRE(std::string(path, normalizePath(path, path + sizeof(path) - 1, path)) == "/a/c");
+}
+
+TEST_CASE("Look up routes by key", "[RouteTable]") {
+
+    RouteTable table;
+    REQUIRE(table.empty());
+    REQUIRE(table.find(0, 0) == 0);
+
+    for (std::size_t i = 0; i < 100; ++i)
+        table.add("/route/" + std::to_string(i), i);
+    table.add("/route/7", 100);
+    table.add("", 101);
+
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        const std::string key = "/route/" + std::to_string(i);
+        const std::vector<std::size_t> *routes = table.find(key.data(), key.data() + key.size());
+        REQUIRE(routes != 0);
+        REQUIRE(routes->front() == i);
+    }
+    const std::string seven = "/route/7";
+    REQUIRE(*table.find(seven.data(), seven.data() + seven.size()) == std::vector<std::size_t>({7, 100}));
+    REQUIRE(*table.find(seven.data(), seven.data()) == std::vector<std::size_t>({101}));
+    const std::string missing = "/route/100";
+    REQUIRE(table.find(missing.data(), missing.data() + missing.size()) == 0);
+}
+
+TEST_CASE("Reuse monotonic buffers", "[MonotonicBuffer]") {
+
+    MonotonicBuffer buffer;
+    std::vector<int, MonotonicAllocator<int> > values((MonotonicAllocator<int>(buffer)));
+    for (int i = 0; i < 1000; ++i)
+        values.push_back(i);
+    REQUIRE(values[999] == 999);
+
+    // After a release the largest block is reused.
+    void *first = buffer.allocate(1000);
+    buffer.release();
+    REQUIRE(buffer.allocate(1000) != first);
+    buffer.release();
+    void *reused = buffer.allocate(1000);
+    buffer.release();
+    REQUIRE(buffer.allocate(1000) == reused);
+
+    MonotonicBufferPool pool;
+    MonotonicBuffer *leased;
+    {
+        MonotonicBufferPool::Lease a(pool), b(pool);
+        REQUIRE(&*a != &*b);
+        leased = &*a;
+        REQUIRE(pool.idle() == 0);
+    }
+    REQUIRE(pool.idle() == 2);
+    MonotonicBufferPool::Lease c(pool);
+    REQUIRE(pool.idle() == 1);
+    REQUIRE(&*c == leased);
+
+    // Default-constructed allocators use the heap.
+    std::vector<int, MonotonicAllocator<int> > heap(100, 1);
+    REQUIRE(heap.get_allocator().buffer() == 0);
+}
+
+TEST_CASE("Parse query strings", "[parseQueryString]") {
+
+    const std::string qs = "a=1&b=&&c&a=x%20y&=";
+    std::vector<QueryParam> params;
+    parseQueryString(qs.data(), qs.data() + qs.size(), params);
+    REQUIRE(params.size() == 4);
+    REQUIRE(params[0].key == "a");
+    REQUIRE(params[0].value == "1");
+    REQUIRE(params[1].key == "b");
+    REQUIRE(params[1].value.empty());
+    REQUIRE(params[2].key == "c");
+    REQUIRE(params[2].value.empty());
+    REQUIRE(params[3].key == "a");
+    REQUIRE(params[3].value == "x%20y");
+    // Views point into the original string.
+    REQUIRE(params[3].value.data() == qs.data() + qs.find("x%20y"));
+}
 
 struct XRequest
 {
@@ -192,3 +620,887 @@ TEST_CASE("Test HttpRouter", "[httpRouter]") {
     REQUIRE(res.results == std::vector<std::string>({"USER PROCESSING: PUT /user/789", "DEFAULT: PUT /user/789"}));
     res.clear();
 }
+
+TEST_CASE("Access decoded route parameters", "[httpRouter]") {
+    XHttpRouter router;
+    std::vector<std::string> params;
+    bool sameBuffer = false;
+
+    router.add("GET", "/files/:dir/:name?", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        params.push_back(ctx.param("dir").to_string());
+        params.push_back(ctx.rawParam(2).to_string());
+        params.push_back(ctx.param("name").to_string());
+        params.push_back(ctx.param("missing").to_string());
+        // Views without escapes point into the request path.
+        sameBuffer = ctx.param(1).data() == ctx.rawParam(1).data();
+    });
+
+    XRequest req("GET", "/files/docs/annual%20report+2015.pdf");
+    XResponse res;
+    router.handleRequest(req, res);
+    REQUIRE(params == std::vector<std::string>({"docs", "annual%20report+2015.pdf", "annual report 2015.pdf", ""}));
+    REQUIRE(sameBuffer);
+
+    params.clear();
+    req = XRequest("GET", "/files/a%2Fb");
+    router.handleRequest(req, res);
+    REQUIRE(params == std::vector<std::string>({"a/b", "", "", ""}));
+    REQUIRE_FALSE(sameBuffer);
+}
+
+TEST_CASE("Access query parameters", "[httpRouter]") {
+    XHttpRouter router;
+    std::vector<std::string> values;
+    std::size_t count = 0;
+
+    router.add("GET", "/search", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        values.push_back(ctx.query("q").to_string());
+        values.push_back(ctx.query("tag").to_string());
+        values.push_back(ctx.query("tag", 1).to_string());
+        values.push_back(ctx.query("a b").to_string());
+        REQUIRE(ctx.query("tag", 2).data() == 0);
+        REQUIRE(ctx.query("missing").data() == 0);
+        count = ctx.queryParams().size();
+    });
+
+    XRequest req("GET", "/search?q=caf%C3%A9+au+lait&tag=x&tag=y&a+b=c");
+    XResponse res;
+    router.handleRequest(req, res);
+    REQUIRE(values == std::vector<std::string>({"caf\xC3\xA9 au lait", "x", "y", "c"}));
+    REQUIRE(count == 4);
+}
+
+TEST_CASE("Limit routed path length", "[httpRouter]") {
+    XHttpRouter router;
+    std::vector<std::string> results;
+
+    router.add("*", "*", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        results.push_back("route " + req.uriPath);
+    });
+    router.setMaxPathLength(8, [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        results.push_back("414");
+        ctx.next();
+    });
+    REQUIRE(router.maxPathLength() == 8);
+
+    XRequest req("GET", "/1234567?query=is-not-counted");
+    XResponse res;
+    router.handleRequest(req, res);
+    req = XRequest("GET", "/12345678");
+    router.handleRequest(req, res);
+    REQUIRE(results == std::vector<std::string>({"route /1234567?query=is-not-counted", "414"}));
+}
+
+TEST_CASE("Reject routes which require backtracking", "[httpRouter]") {
+    XHttpRouter router;
+    auto handler = [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) { };
+
+    router.add("GET", "/user/:id(\\d+)", handler);
+    router.add("GET", "/:x(\\w+\\b\\w+)", handler);
+    REQUIRE(router.routeCount() == 2);
+    REQUIRE(router.routeAnalysis(0).routeClass == RC_NATIVE);
+    REQUIRE(router.routeAnalysis(1).routeClass == RC_BACKTRACKING);
+
+    router.setRejectRiskyRoutes(true);
+    REQUIRE_THROWS_AS(router.add("GET", "/:x(\\w+\\b)+", handler), std::logic_error);
+    router.add("GET", "/:word(\\w+\\w+\\w+)\\.json", handler);
+    REQUIRE(router.routeCount() == 3);
+    REQUIRE(router.routeAnalysis(2).routeClass == RC_LINEAR);
+}
+
+TEST_CASE("Fold the path case once", "[httpRouter]") {
+    XHttpRouter router;
+    std::vector<std::string> params;
+
+    router.add("GET", "/Users/:name/Files/:file(\\w+\\.[a-z]+)", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        params.push_back(ctx.param("name").to_string());
+        params.push_back(ctx.param("file").to_string());
+    });
+
+    XRequest req("GET", "/USERS/JohnDoe/files/Report.PDF");
+    XResponse res;
+    router.handleRequest(req, res);
+    router.setFoldCaseOnce(false);
+    router.handleRequest(req, res);
+    REQUIRE(params == std::vector<std::string>({"JohnDoe", "Report.PDF", "JohnDoe", "Report.PDF"}));
+}
+
+TEST_CASE("Match static routes in registration order", "[httpRouter]") {
+    XHttpRouter router;
+    std::vector<std::string> results;
+    auto handler = [&](const std::string &name) {
+        return [&results, name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            results.push_back(name + " " + ctx.match(0));
+            ctx.next();
+        };
+    };
+
+    router.add("*", "/user/*", handler("all"));
+    router.add("GET", "/user/me", handler("me"));
+    router.add("GET", "/user/:id", handler("id"));
+    router.add("PUT", "/user/me", handler("put"));
+    router.add("GET", "/healthz", handler("health"));
+    router.add("GET", "/", handler("root"));
+    router.add("*", "*", handler("default"));
+
+    XRequest req("GET", "/user/me");
+    XResponse res;
+    router.handleRequest(req, res);
+    REQUIRE(results == std::vector<std::string>({"all /user/me", "me /user/me", "id /user/me", "default /user/me"}));
+
+    results.clear();
+    req = XRequest("GET", "/USER/Me/?x=1");
+    router.handleRequest(req, res);
+    REQUIRE(results == std::vector<std::string>({"all /USER/Me/", "me /USER/Me/", "id /USER/Me/", "default /USER/Me/"}));
+
+    results.clear();
+    req = XRequest("GET", "/healthz/");
+    router.handleRequest(req, res);
+    req = XRequest("GET", "/");
+    router.handleRequest(req, res);
+    req = XRequest("GET", "");
+    router.handleRequest(req, res);
+    REQUIRE(results == std::vector<std::string>({"health /healthz/", "default /healthz/", "root /", "default /",
+                                                 "root ", "default "}));
+}
+
+TEST_CASE("Dispatch by the first path segment", "[httpRouter]") {
+    XHttpRouter router;
+    std::vector<std::string> results;
+    auto handler = [&](const std::string &name) {
+        return [&results, name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            results.push_back(name);
+            ctx.next();
+        };
+    };
+
+    router.add("*", "/:service/*", handler("service"));
+    router.add("GET", "/users/:id", handler("users"));
+    router.add("GET", "/groups/:id", handler("groups"));
+    router.add("GET", "/api.:format", handler("format"));
+    router.add("*", "*", handler("default"));
+    router.add("GET", "/users/:id/:tab?", handler("tab"));
+
+    XResponse res;
+    const char *paths[] = { "/users/5", "/GROUPS/7", "/other/1", "/api.json", "/users" };
+    for (const char *path : paths)
+    {
+        XRequest req("GET", path);
+        router.handleRequest(req, res);
+        results.push_back("|");
+    }
+    REQUIRE(results == std::vector<std::string>({
+        "service", "users", "default", "tab", "|",
+        "service", "groups", "default", "|",
+        "service", "default", "|",
+        "format", "default", "|",
+        "default", "|"}));
+}
+
+TEST_CASE("Reject candidates by method and literal prefix", "[httpRouter]") {
+    XHttpRouter router;
+    std::vector<std::string> results;
+    auto handler = [&](const std::string &name) {
+        return [&results, name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            results.push_back(name);
+            ctx.next();
+        };
+    };
+
+    router.add("GET", "/files/:name", handler("get"));
+    router.add("PURGE", "/files/:name", handler("purge"));
+    router.add("", "/files/:name", handler("empty"));
+    router.add("*", "/files/:name", handler("any"));
+    router.add("GET", "/files/archive/:name", handler("archive"));
+    router.add("GET", "/files/", handler("slash"));
+    router.add("GET", "/f:rest", handler("short"));
+
+    XResponse res;
+    const char *requests[][2] = {
+        { "GET", "/FILES/x" }, { "PURGE", "/files/x" }, { "LOCK", "/files/x" },
+        { "GET", "/files/archive/x" }, { "GET", "/files" }, { "GET", "/f" }
+    };
+    for (const auto &r : requests)
+    {
+        XRequest req(r[0], r[1]);
+        router.handleRequest(req, res);
+        results.push_back("|");
+    }
+    REQUIRE(results == std::vector<std::string>({
+        "get", "empty", "any", "|",
+        "purge", "empty", "any", "|",
+        "empty", "any", "|",
+        "archive", "|",
+        "slash", "short", "|",
+        "|"}));
+}
+
+TEST_CASE("Cache paths which match no route", "[httpRouter]") {
+    XHttpRouter router;
+    std::vector<std::string> results;
+    auto handler = [&](const std::string &name) {
+        return [&results, name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            results.push_back(name);
+            ctx.next();
+        };
+    };
+
+    router.add("GET", "/users/:id", handler("users"));
+    router.add("*", "*", handler("default"));
+    REQUIRE(router.negativeCacheSize() == 1024);
+
+    XResponse res;
+    auto request = [&](const char *method, const char *path) {
+        XRequest req(method, path);
+        router.handleRequest(req, res);
+        results.push_back("|");
+    };
+
+    // The second request is answered from the cache.
+    request("GET", "/wp-login.php");
+    request("GET", "/wp-login.php");
+    request("POST", "/users/1");
+    request("GET", "/users/1");
+    REQUIRE(results == std::vector<std::string>({
+        "default", "|", "default", "|", "default", "|", "users", "default", "|"}));
+
+    // Adding routes invalidates the cache.
+    results.clear();
+    router.add("GET", "/wp-login.php", handler("login"));
+    router.add("POST", "/users/:id", handler("post"));
+    request("GET", "/wp-login.php");
+    request("POST", "/users/1");
+    REQUIRE(results == std::vector<std::string>({"default", "login", "|", "default", "post", "|"}));
+
+    // So does replacing the router.
+    results.clear();
+    request("GET", "/missing");
+    XHttpRouter reloaded;
+    reloaded.add("GET", "/missing", handler("found"));
+    reloaded.add("*", "*", handler("default"));
+    router = reloaded;
+    request("GET", "/missing");
+    REQUIRE(results == std::vector<std::string>({"default", "|", "found", "default", "|"}));
+
+    results.clear();
+    router.setNegativeCacheSize(0);
+    request("GET", "/nothing");
+    request("GET", "/nothing");
+    REQUIRE(results == std::vector<std::string>({"default", "|", "default", "|"}));
+}
+
+TEST_CASE("Keep the caches of several routers", "[CacheSet]") {
+    CacheSet<NegativeCache, 2> caches;
+    const std::string get = "GET";
+    const std::string a = "/a", b = "/b";
+    REQUIRE(caches.find(1) == 0);
+
+    caches.acquire(1, 16).insert(get, a.data(), a.data() + a.size());
+    caches.acquire(2, 16).insert(get, b.data(), b.data() + b.size());
+    // Alternating generations keep their entries.
+    for (int i = 0; i < 3; ++i)
+    {
+        REQUIRE(caches.acquire(1, 16).contains(get, a.data(), a.data() + a.size()));
+        REQUIRE(!caches.acquire(1, 16).contains(get, b.data(), b.data() + b.size()));
+        REQUIRE(caches.acquire(2, 16).contains(get, b.data(), b.data() + b.size()));
+    }
+
+    // A third generation replaces the least recently used one.
+    REQUIRE(!caches.acquire(3, 16).contains(get, a.data(), a.data() + a.size()));
+    REQUIRE(caches.find(1) == 0);
+    REQUIRE(caches.find(2) != 0);
+    REQUIRE(caches.find(3) != 0);
+}
+
+TEST_CASE("Cache paths of routers used in turn", "[httpRouter]") {
+    XHttpRouter first, second;
+    auto handler = [](const std::string &name) {
+        return [name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            res.results.push_back(name);
+            ctx.next();
+        };
+    };
+    first.add("GET", "/first/:id", handler("first"));
+    first.add("*", "*", handler("first default"));
+    second.add("GET", "/second/:id", handler("second"));
+    second.add("*", "*", handler("second default"));
+
+    auto handle = [](XHttpRouter &router, const char *path) {
+        XRequest req("GET", path);
+        XResponse res;
+        router.handleRequest(req, res);
+        return res.results;
+    };
+    for (int i = 0; i < 3; ++i)
+    {
+        REQUIRE(handle(first, "/second/1") == std::vector<std::string>({"first default"}));
+        REQUIRE(handle(second, "/first/1") == std::vector<std::string>({"second default"}));
+        REQUIRE(handle(first, "/first/1") == std::vector<std::string>({"first", "first default"}));
+        REQUIRE(handle(second, "/second/1") == std::vector<std::string>({"second", "second default"}));
+    }
+}
+
+TEST_CASE("Route requests in batches", "[httpRouter]") {
+    XHttpRouter router;
+    auto handler = [](const std::string &name) {
+        return [name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            res.results.push_back(name + " " + ctx.match());
+            ctx.next();
+        };
+    };
+
+    router.add("GET", "/users", handler("list"));
+    router.add("GET", "/users/:id", handler("user"));
+    router.add("POST", "/users/:id", handler("update"));
+    router.add("GET", "/groups/:id", handler("group"));
+    router.add("GET", "/:any/info", handler("info"));
+    router.add("*", "*", handler("default"));
+    router.setMaxPathLength(32);
+
+    std::vector<XRequest> requests;
+    std::vector<std::string> paths;
+    const char *methods[] = { "GET", "POST", "PURGE" };
+    for (int i = 0; i < 40; ++i)
+    {
+        const char *prefixes[] = { "/users", "/users/", "/Groups/", "/x/", "/nothing/here/", "/long/long/long/long/long/" };
+        const std::string path = std::string(prefixes[i % 6]) + (i % 4 == 0 ? "info" : std::to_string(i));
+        requests.push_back(XRequest(methods[i % 3], path + (i % 5 == 0 ? "?q=1" : "")));
+        if (i % 3 == 0)
+            paths.push_back(path);
+    }
+
+    std::vector<XResponse> responses(requests.size()), expected(requests.size());
+    router.handleRequests(requests.begin(), requests.end(), responses.begin());
+    for (std::size_t i = 0; i < requests.size(); ++i)
+    {
+        router.handleRequest(requests[i], expected[i]);
+        INFO(requests[i].method << " " << requests[i].uriPath);
+        REQUIRE(responses[i].results == expected[i].results);
+    }
+
+    std::vector<std::size_t> routes;
+    router.matchBatch("GET", paths, routes);
+    REQUIRE(routes.size() == paths.size());
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        INFO(paths[i]);
+        XRequest req("GET", paths[i]);
+        XResponse res;
+        router.handleRequest(req, res);
+        if (res.results.empty())
+            REQUIRE(routes[i] == XHttpRouter::NO_ROUTE);
+        else
+            REQUIRE(res.results[0].substr(0, res.results[0].find(' ')) ==
+                    std::vector<std::string>({"list", "user", "update", "group", "info", "default"})[routes[i]]);
+    }
+
+    router.matchBatch("POST", std::vector<std::string>({"/USERS/7", "/users", "/long/long/long/long/long/long/long"}), routes);
+    REQUIRE(routes == std::vector<std::size_t>({2, 5, XHttpRouter::NO_ROUTE}));
+}
+
+TEST_CASE("Access path segments", "[httpRouter]") {
+    XHttpRouter router;
+    std::vector<std::string> segments;
+
+    router.add("GET", "/files/*", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        const PathSegments &s = ctx.pathSegments();
+        for (std::size_t i = 0; i < s.size(); ++i)
+            segments.push_back(s[i].to_string());
+    });
+
+    XRequest req("GET", "/Files/a/b%20c/?x=/y");
+    XResponse res;
+    router.handleRequest(req, res);
+    REQUIRE(segments == std::vector<std::string>({"", "Files", "a", "b%20c", ""}));
+}
+
+TEST_CASE("Normalize paths before routing", "[httpRouter]") {
+    XHttpRouter router;
+    auto handler = [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        res.results.push_back(ctx.match(1) + " " + ctx.path().to_string() + " " +
+                              (ctx.pathChanged() ? "changed" : "same") + " " + ctx.queryString().to_string());
+    };
+    router.add("GET", "/users/:id", handler);
+    router.add("GET", "/", handler);
+
+    XRequest req("GET", "//users/./x/../%7E5/?q=/a/../b");
+    XResponse res;
+    router.handleRequest(req, res);
+    REQUIRE(res.results.empty());
+
+    router.setPathNormalization(NP_ALL);
+    REQUIRE(router.pathNormalization() == NP_ALL);
+    router.handleRequest(req, res);
+    XRequest canonical("GET", "/users/5"), root("GET", "/a/..");
+    router.handleRequest(canonical, res);
+    router.handleRequest(root, res);
+    REQUIRE(res.results == std::vector<std::string>({"~5 /users/~5 changed q=/a/../b", "5 /users/5 same ", " / changed "}));
+
+    std::vector<XRequest> requests({req, canonical});
+    std::vector<XResponse> responses(2);
+    router.handleRequests(requests.begin(), requests.end(), responses.begin());
+    REQUIRE(responses[0].results == std::vector<std::string>({"~5 /users/~5 changed q=/a/../b"}));
+    REQUIRE(responses[1].results == std::vector<std::string>({"5 /users/5 same "}));
+
+    std::vector<std::size_t> routes;
+    router.matchBatch("GET", std::vector<std::string>({"/users//./7/", "/x/..", "/x/y"}), routes);
+    REQUIRE(routes == std::vector<std::size_t>({0, 1, XHttpRouter::NO_ROUTE}));
+}
+
+TEST_CASE("Allocate from the request arena", "[httpRouter]") {
+    XHttpRouter router;
+    MonotonicBuffer *arena = 0, *outer = 0;
+    std::string joined;
+
+    router.add("GET", "/users/:id/:name", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        std::vector<StringRef, MonotonicAllocator<StringRef> > params(ctx.allocator<StringRef>());
+        params.push_back(ctx.param("name"));
+        params.push_back(ctx.param("id"));
+        std::basic_string<char, std::char_traits<char>, MonotonicAllocator<char> > s(ctx.allocator());
+        for (StringRef p : params)
+            s.append(p.data(), p.size()).append(1, ' ');
+        joined.assign(s.data(), s.size());
+        arena = &ctx.arena();
+    });
+    router.add("GET", "/nested", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        outer = &ctx.arena();
+        XRequest inner("GET", "/users/7/a%20b");
+        router.handleRequest(inner, res);
+    });
+
+    XRequest req("GET", "/users/5/bob");
+    XResponse res;
+    router.handleRequest(req, res);
+    REQUIRE(joined == "bob 5 ");
+
+    // The arena of the finished request is reused, a request routed from
+    // a handler gets an arena of its own.
+    MonotonicBuffer *first = arena;
+    XRequest nested("GET", "/nested");
+    router.handleRequest(nested, res);
+    REQUIRE(joined == "a b 7 ");
+    REQUIRE(outer == first);
+    REQUIRE(arena != first);
+}
+
+TEST_CASE("Dispatch a shared route by method", "[httpRouter]") {
+    XHttpRouter router;
+    auto handler = [](const std::string &name) {
+        return [name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            res.results.push_back(name + " " + ctx.match(1));
+        };
+    };
+
+    router.add("GET", "/users/me", handler("me"));
+    XHttpRouter::RouteHandle users = router.route("/users/:id");
+    users.get(handler("show")).put(handler("update")).del(handler("remove"));
+    router.route("/files/:name").method("PURGE", handler("purge")).all(handler("file"));
+    router.add("*", "*", handler("default"));
+    REQUIRE(router.routeCount() == 4);
+    REQUIRE(users.index() == 1);
+
+    auto handle = [&](const std::string &method, const std::string &path) {
+        XRequest req(method, path);
+        XResponse res;
+        router.handleRequest(req, res);
+        return res.results;
+    };
+    REQUIRE(handle("GET", "/users/7") == std::vector<std::string>({"show 7"}));
+    REQUIRE(handle("PUT", "/users/7") == std::vector<std::string>({"update 7"}));
+    REQUIRE(handle("DELETE", "/users/7") == std::vector<std::string>({"remove 7"}));
+    REQUIRE(handle("POST", "/users/7") == std::vector<std::string>({"default /users/7"}));
+    REQUIRE(handle("GET", "/users/me") == std::vector<std::string>({"me "}));
+    REQUIRE(handle("PURGE", "/files/a") == std::vector<std::string>({"purge a"}));
+    REQUIRE(handle("POST", "/files/a") == std::vector<std::string>({"file a"}));
+    REQUIRE(handle("REPORT", "/files/a") == std::vector<std::string>({"file a"}));
+
+    // Methods added later are routed even if the request was cached as not found.
+    users.post(handler("create"));
+    REQUIRE(handle("POST", "/users/7") == std::vector<std::string>({"create 7"}));
+    users.put(handler("replace"));
+    REQUIRE(handle("PUT", "/users/7") == std::vector<std::string>({"replace 7"}));
+}
+
+TEST_CASE("Report the allowed methods of a path", "[httpRouter]") {
+    XHttpRouter router;
+    auto handler = [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        res.results.push_back(req.method + " " + req.uriPath);
+    };
+
+    router.add("GET", "/user/:id(\\d+)", handler);
+    router.add("DELETE", "/user/:id(\\d+)", handler);
+    router.add("GET", "/user/:name", handler);
+    router.route("/files/:name").put(handler).method("PURGE", handler);
+    router.add("*", "/public/*", handler);
+    router.add("POST", "/user/new", handler);
+    router.add("*", "*", [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        const std::uint32_t allowed = ctx.allowedMethods();
+        if (req.method == "OPTIONS" || allowed != 0)
+            res.results.push_back((req.method == "OPTIONS" ? "200 Allow: " : "405 Allow: ") + XHttpRouter::methodNames(allowed));
+        else
+            res.results.push_back("404");
+    });
+
+    REQUIRE(router.allowedMethods("/user/789") == (XHttpRouter::METHOD_GET | XHttpRouter::METHOD_DELETE));
+    REQUIRE(router.allowedMethods("/user/bob") == XHttpRouter::METHOD_GET);
+    REQUIRE(router.allowedMethods("/USER/new") == (XHttpRouter::METHOD_GET | XHttpRouter::METHOD_POST));
+    REQUIRE(router.allowedMethods("/files/a") == (XHttpRouter::METHOD_PUT | XHttpRouter::METHOD_OTHER));
+    REQUIRE(router.allowedMethods("/public/a.css") == XHttpRouter::ALL_METHODS);
+    REQUIRE(router.allowedMethods("/nothing") == 0);
+    REQUIRE(XHttpRouter::methodNames(XHttpRouter::METHOD_PUT | XHttpRouter::METHOD_OTHER) == "PUT");
+    REQUIRE(XHttpRouter::methodNames(0) == "");
+
+    auto handle = [&](const std::string &method, const std::string &path) {
+        XRequest req(method, path);
+        XResponse res;
+        router.handleRequest(req, res);
+        return res.results;
+    };
+    REQUIRE(handle("PUT", "/user/789") == std::vector<std::string>({"405 Allow: GET, DELETE"}));
+    REQUIRE(handle("OPTIONS", "/user/new") == std::vector<std::string>({"200 Allow: GET, POST"}));
+    REQUIRE(handle("GET", "/files/a") == std::vector<std::string>({"405 Allow: PUT"}));
+    REQUIRE(handle("GET", "/nothing") == std::vector<std::string>({"404"}));
+    REQUIRE(handle("DELETE", "/user/789") == std::vector<std::string>({"DELETE /user/789"}));
+}
+
+TEST_CASE("Mount handlers and routers on path prefixes", "[httpRouter]") {
+    XHttpRouter router, api, users;
+    auto handler = [](const std::string &name) {
+        return [name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            res.results.push_back(name + " " + ctx.basePath().to_string() + " " + ctx.path().to_string());
+        };
+    };
+    auto middleware = [](const std::string &name) {
+        return [name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            res.results.push_back(name + " " + ctx.path().to_string());
+            ctx.next();
+        };
+    };
+
+    users.add("GET", "/", handler("list"));
+    users.add("GET", "/:id", handler("user"));
+    api.use("/", middleware("api"));
+    api.mount("/users", users);
+    api.add("GET", "/status", handler("status"));
+    router.use("/api", middleware("log"));
+    router.mount("/api", api);
+    router.add("GET", "/apis", handler("apis"));
+    router.add("*", "*", handler("default"));
+
+    REQUIRE(router.routeAnalysis(0).routeClass == RC_NATIVE);
+
+    auto handle = [&](const std::string &method, const std::string &path) {
+        XRequest req(method, path);
+        XResponse res;
+        router.handleRequest(req, res);
+        return res.results;
+    };
+    REQUIRE(handle("GET", "/api/users/5?x=1") ==
+            std::vector<std::string>({"log /api/users/5", "api /users/5", "user /api/users /5"}));
+    REQUIRE(handle("GET", "/API/Users") ==
+            std::vector<std::string>({"log /API/Users", "api /Users", "list /API/Users "}));
+    REQUIRE(handle("GET", "/api/status") ==
+            std::vector<std::string>({"log /api/status", "api /status", "status /api /status"}));
+    REQUIRE(handle("GET", "/apis") == std::vector<std::string>({"apis  /apis"}));
+    // Requests which are not handled by a mounted router continue after its mount point.
+    REQUIRE(handle("POST", "/api/users/5") ==
+            std::vector<std::string>({"log /api/users/5", "api /users/5", "default  /api/users/5"}));
+    REQUIRE(handle("GET", "/api/users/5/posts") ==
+            std::vector<std::string>({"log /api/users/5/posts", "api /users/5/posts", "default  /api/users/5/posts"}));
+
+    // Prefixes do not answer for methods.
+    REQUIRE(router.allowedMethods("/api/status") == 0);
+    REQUIRE(api.allowedMethods("/status") == XHttpRouter::METHOD_GET);
+}
+
+TEST_CASE("Match routes with their own options", "[httpRouter]") {
+    XHttpRouter router;
+    auto handler = [](const std::string &name) {
+        return [name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            res.results.push_back(name + " " + ctx.match(0));
+        };
+    };
+
+    router.add("GET", "/Exact", PR_SENSITIVE | PR_STRICT | PR_END, handler("exact"));
+    router.add("GET", "/files/:name", PR_SENSITIVE | PR_END, handler("file"));
+    router.add("GET", "/docs", PR_STRICT, handler("docs"));
+    router.add("GET", "/static", handler("static"));
+    router.setDefaultOptions(PR_SENSITIVE | PR_END);
+    router.add("GET", "/Upper", handler("upper"));
+    router.route("/Items").get(handler("items"));
+    router.add("*", "*", handler("default"));
+
+    REQUIRE(router.defaultOptions() == (PR_SENSITIVE | PR_END));
+
+    auto handle = [&](const std::string &method, const std::string &path) {
+        XRequest req(method, path);
+        XResponse res;
+        router.handleRequest(req, res);
+        return res.results;
+    };
+    REQUIRE(handle("GET", "/Exact") == std::vector<std::string>({"exact /Exact"}));
+    REQUIRE(handle("GET", "/exact") == std::vector<std::string>({"default /exact"}));
+    REQUIRE(handle("GET", "/Exact/") == std::vector<std::string>({"default /Exact/"}));
+    REQUIRE(handle("GET", "/files/a.txt/") == std::vector<std::string>({"file /files/a.txt/"}));
+    REQUIRE(handle("GET", "/Files/a.txt") == std::vector<std::string>({"default /Files/a.txt"}));
+    // Without PR_END the route matches a prefix of the path.
+    REQUIRE(handle("GET", "/DOCS/intro") == std::vector<std::string>({"docs /DOCS"}));
+    REQUIRE(handle("GET", "/docs-old") == std::vector<std::string>({"default /docs-old"}));
+    REQUIRE(handle("GET", "/STATIC/") == std::vector<std::string>({"static /STATIC/"}));
+    REQUIRE(handle("GET", "/Upper") == std::vector<std::string>({"upper /Upper"}));
+    REQUIRE(handle("GET", "/upper") == std::vector<std::string>({"default /upper"}));
+    REQUIRE(handle("GET", "/Items/") == std::vector<std::string>({"items /Items/"}));
+    REQUIRE(handle("GET", "/items") == std::vector<std::string>({"default /items"}));
+
+    REQUIRE(router.allowedMethods("/Exact") == XHttpRouter::METHOD_GET);
+    REQUIRE(router.allowedMethods("/exact") == 0);
+}
+
+TEST_CASE("Route several paths with one handler", "[httpRouter]") {
+    XHttpRouter router;
+    auto handler = [](const std::string &name) {
+        return [name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            res.results.push_back(name + " " + std::to_string(ctx.alternative()) + " " + ctx.param("id").to_string());
+            ctx.next();
+        };
+    };
+
+    router.add("GET", {"/users/:id", "/u/:id", "/members/:id/profile", "/me"}, handler("user"));
+    const std::vector<std::string> aliases = {"/old/:id", "/older/:id"};
+    router.add("GET", aliases.begin(), aliases.end(), PR_SENSITIVE | PR_END, handler("old"));
+    router.add("*", "*", [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        res.results.push_back("default " + std::to_string(ctx.alternative()));
+    });
+
+    REQUIRE(router.routeCount() == 7);
+    REQUIRE_THROWS_AS(router.add("GET", aliases.end(), aliases.end(), handler("none")), std::logic_error);
+
+    // A rejected path adds none of the paths.
+    router.setRejectRiskyRoutes(true);
+    REQUIRE_THROWS_AS(router.add("GET", {"/rejected", "/:x(\\w+\\b)+"}, handler("rejected")), std::logic_error);
+    router.setRejectRiskyRoutes(false);
+    REQUIRE(router.routeCount() == 7);
+
+    auto handle = [&](const std::string &method, const std::string &path) {
+        XRequest req(method, path);
+        XResponse res;
+        router.handleRequest(req, res);
+        return res.results;
+    };
+    REQUIRE(handle("GET", "/users/1") == std::vector<std::string>({"user 0 1", "default 0"}));
+    REQUIRE(handle("GET", "/U/2") == std::vector<std::string>({"user 1 2", "default 0"}));
+    REQUIRE(handle("GET", "/members/3/profile") == std::vector<std::string>({"user 2 3", "default 0"}));
+    REQUIRE(handle("GET", "/me") == std::vector<std::string>({"user 3 ", "default 0"}));
+    REQUIRE(handle("GET", "/older/4") == std::vector<std::string>({"old 1 4", "default 0"}));
+    REQUIRE(handle("GET", "/Old/5") == std::vector<std::string>({"default 0"}));
+    REQUIRE(handle("POST", "/users/1") == std::vector<std::string>({"default 0"}));
+    REQUIRE(handle("GET", "/rejected") == std::vector<std::string>({"default 0"}));
+}
+
+TEST_CASE("Run a multi-path route once per request", "[httpRouter]") {
+    XHttpRouter router;
+    router.add("GET", {"/files/*", "/files/:name"}, [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        res.results.push_back("files " + std::to_string(ctx.alternative()));
+        ctx.next();
+    });
+    router.add("GET", "/files/:name", [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        res.results.push_back("file " + ctx.param("name").to_string());
+    });
+
+    XRequest req("GET", "/files/a.txt");
+    XResponse res;
+    router.handleRequest(req, res);
+    REQUIRE(res.results == std::vector<std::string>({"files 0", "file a.txt"}));
+}
+
+TEST_CASE("Detect digit patterns", "[paramFormat]") {
+    REQUIRE(paramFormat("\\d+") == PF_DIGITS);
+    REQUIRE(paramFormat("[0-9]+?") == PF_DIGITS);
+    REQUIRE(paramFormat("\\d{4}") == PF_DIGITS);
+    REQUIRE(paramFormat("\\d{1,9}") == PF_DIGITS);
+    REQUIRE(paramFormat("\\d{2,}") == PF_DIGITS);
+    REQUIRE(paramFormat("\\d*") == PF_ANY);
+    REQUIRE(paramFormat("\\d{0,3}") == PF_ANY);
+    REQUIRE(paramFormat("\\d+\\w") == PF_ANY);
+    REQUIRE(paramFormat("[^\\/#\\?]+?") == PF_ANY);
+}
+
+TEST_CASE("Convert digits to signed integers", "[ParamTraits]") {
+    const PathKey key = {"id", "/", "/", false, false, "\\d+"};
+    int i = 0;
+    std::int64_t l = 0;
+    // Values of up to digits10 digits cannot overflow.
+    REQUIRE(ParamTraits<int>::parse(StringRef("999999999"), key, PF_DIGITS, i));
+    REQUIRE(i == 999999999);
+    REQUIRE(ParamTraits<std::int64_t>::parse(StringRef("999999999999999999"), key, PF_DIGITS, l));
+    REQUIRE(l == 999999999999999999LL);
+    REQUIRE(ParamTraits<int>::parse(StringRef("007"), key, PF_DIGITS, i));
+    REQUIRE(i == 7);
+    REQUIRE(!ParamTraits<int>::parse(StringRef("1:"), key, PF_ANY, i));
+    // Longer values are checked for overflow.
+    REQUIRE(ParamTraits<int>::parse(StringRef("2147483647"), key, PF_DIGITS, i));
+    REQUIRE(i == 2147483647);
+    REQUIRE(!ParamTraits<int>::parse(StringRef("2147483648"), key, PF_DIGITS, i));
+    REQUIRE(ParamTraits<std::int64_t>::parse(StringRef("9223372036854775807"), key, PF_DIGITS, l));
+    REQUIRE(!ParamTraits<std::int64_t>::parse(StringRef("9223372036854775808"), key, PF_DIGITS, l));
+}
+
+TEST_CASE("Convert route parameters", "[httpRouter]") {
+    enum Kind { PHOTO, VIDEO };
+    XHttpRouter router;
+    std::vector<std::string> results;
+    router.add("GET", "/ints/:id(\\d+)/:n/:small", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        std::int64_t n = 0;
+        std::uint8_t small = 0;
+        const bool valid = ctx.param("n", n);
+        const bool smallValid = ctx.param("small", small);
+        results.push_back(std::to_string(ctx.param<unsigned long long>("id")) + " " +
+                          (valid ? std::to_string(n) : "invalid") + " " +
+                          (smallValid ? std::to_string(small) : "invalid"));
+    });
+    router.add("GET", "/media/:kind(photo|video)/:id", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        const Uuid id = ctx.param<Uuid>("id");
+        results.push_back(std::to_string(ctx.param<Kind>("kind")) + " " + std::to_string(id.bytes[0]) + " " +
+                          std::to_string(id.bytes[15]));
+    });
+    router.add("GET", "/commits/:sha/:flag/:name", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        HexId<4> sha;
+        const bool valid = ctx.param("sha", sha);
+        results.push_back((valid ? std::to_string(sha.bytes[0]) + "," + std::to_string(sha.bytes[3]) : "invalid") + " " +
+                          (ctx.param<bool>("flag") ? "on" : "off") + " " + ctx.param<std::string>("name") + " " +
+                          ctx.param<StringRef>("name").to_string());
+        REQUIRE_THROWS_AS(ctx.param<int>("name"), std::logic_error);
+        REQUIRE_THROWS_AS(ctx.param<int>("missing"), std::logic_error);
+    });
+
+    auto handle = [&](const std::string &path) {
+        results.clear();
+        XRequest req("GET", path);
+        XResponse res;
+        router.handleRequest(req, res);
+        return results;
+    };
+    REQUIRE(handle("/ints/18446744073709551615/-9223372036854775808/255") ==
+            std::vector<std::string>({"18446744073709551615 -9223372036854775808 255"}));
+    REQUIRE(handle("/ints/0/12x/256") == std::vector<std::string>({"0 invalid invalid"}));
+    REQUIRE(handle("/ints/7/%2D5/-1") == std::vector<std::string>({"7 -5 invalid"}));
+    REQUIRE(handle("/media/video/123e4567-e89b-12d3-a456-4266141740ff") == std::vector<std::string>({"1 18 255"}));
+    REQUIRE(handle("/media/PHOTO/123E4567E89B12D3A4564266141740FF") == std::vector<std::string>({"0 18 255"}));
+    REQUIRE(handle("/commits/deadBEEF/true/a%20b") == std::vector<std::string>({"222,239 on a b a b"}));
+    REQUIRE(handle("/commits/deadbeefab/0/x") == std::vector<std::string>({"invalid off x x"}));
+}
+
+TEST_CASE("Load route parameters once per request", "[httpRouter]") {
+    struct Account
+    {
+        std::string name;
+        std::shared_ptr<int> alive;
+    };
+    XHttpRouter router, sub;
+    int loads = 0;
+    std::shared_ptr<int> alive = std::make_shared<int>(0);
+    router.param<Account>("accountId", [&](XHttpRouter::Context &ctx, StringRef id) {
+        ++loads;
+        return Account{"account " + id.to_string(), alive};
+    });
+    router.param<int>("unused", [](XHttpRouter::Context &ctx, StringRef id) -> int {
+        throw std::logic_error("Not loaded");
+    });
+    auto middleware = [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        res.results.push_back("check " + ctx.load<Account>("accountId").name);
+        ctx.next();
+    };
+    router.use("/accounts/:accountId", middleware);
+    router.use("/accounts/:accountId", middleware);
+    router.mount("/accounts/:accountId", sub);
+    router.add("GET", "/accounts/:accountId", [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        res.results.push_back("show " + ctx.load<Account>("accountId").name);
+        REQUIRE_THROWS_AS(ctx.load<int>("accountId"), std::logic_error);
+        REQUIRE_THROWS_AS(ctx.load<Account>("missing"), std::logic_error);
+    });
+    sub.param<std::string>("postId", [&](XHttpRouter::Context &ctx, StringRef id) {
+        ++loads;
+        return "post " + id.to_string();
+    });
+    sub.add("GET", "/posts/:postId", [](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        res.results.push_back("show " + ctx.load<std::string>("postId") + " " + ctx.load<std::string>("postId"));
+    });
+
+    auto handle = [&](const std::string &path) {
+        loads = 0;
+        XRequest req("GET", path);
+        XResponse res;
+        router.handleRequest(req, res);
+        return res.results;
+    };
+    REQUIRE(handle("/accounts/7") ==
+            std::vector<std::string>({"check account 7", "check account 7", "show account 7"}));
+    REQUIRE(loads == 1);
+    REQUIRE(alive.use_count() == 1);
+    REQUIRE(handle("/accounts/8/posts/3") ==
+            std::vector<std::string>({"check account 8", "check account 8", "show post 3 post 3"}));
+    REQUIRE(loads == 2);
+    REQUIRE(alive.use_count() == 1);
+}
+
+TEST_CASE("Replay cached middleware chains", "[httpRouter]") {
+    XHttpRouter router, sub;
+    router.setChainCacheSize(64);
+    REQUIRE(router.chainCacheSize() == 64);
+    auto handler = [](const std::string &name) {
+        return [name](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+            res.results.push_back(name + " " + ctx.match(0) + " " + ctx.match(1));
+            // The request stops at the handler named by the query string.
+            if (ctx.query("stop").to_string() != name)
+                ctx.next();
+        };
+    };
+
+    router.use("/user", handler("auth"));
+    router.add("GET", "/user/:id", handler("show"));
+    router.mount("/user/:id", sub);
+    sub.add("GET", "/", handler("sub"));
+    router.add("GET", "/user/:name", handler("named"));
+    router.add("*", "*", handler("default"));
+
+    auto handle = [&](const std::string &method, const std::string &path) {
+        XRequest req(method, path);
+        XResponse res;
+        router.handleRequest(req, res);
+        return res.results;
+    };
+    const std::vector<std::string> show = {"auth /user ", "show /user/5 5"};
+    const std::vector<std::string> all = {"auth /user ", "show /user/5 5", "sub  ", "named /user/5 5", "default /user/5 /user/5"};
+    for (int i = 0; i < 3; ++i)
+    {
+        REQUIRE(handle("GET", "/user/5?stop=show") == show);
+        // Continues after the cached routes.
+        REQUIRE(handle("GET", "/user/5") == all);
+        REQUIRE(handle("GET", "/user/5?stop=show") == show);
+        REQUIRE(handle("GET", "/user/6?stop=auth") == std::vector<std::string>({"auth /user "}));
+        REQUIRE(handle("POST", "/user/5") == std::vector<std::string>({"auth /user ", "default /user/5 /user/5"}));
+    }
+
+    // Requests routed through another router from a handler keep both chains.
+    XHttpRouter audit;
+    audit.setChainCacheSize(64);
+    audit.add("GET", "/audit/:id", handler("audit"));
+    router.add("GET", "/nested/:id", [&](XRequest &req, XResponse &res, XHttpRouter::Context &ctx) {
+        XRequest nested("GET", "/audit/" + ctx.param("id").to_string());
+        audit.handleRequest(nested, res);
+    });
+    for (int i = 0; i < 3; ++i)
+    {
+        REQUIRE(handle("GET", "/nested/3") ==
+                std::vector<std::string>({"default /nested/3 /nested/3", "audit /audit/3 3"}));
+        REQUIRE(handle("GET", "/user/5?stop=show") == show);
+    }
+
+    // Added routes invalidate the cache.
+    router.add("GET", "/user/:id", handler("late"));
+    REQUIRE(handle("GET", "/user/5?stop=named") ==
+            std::vector<std::string>({"auth /user ", "show /user/5 5", "sub  ", "named /user/5 5"}));
+    REQUIRE(handle("GET", "/user/5?stop=late") ==
+            std::vector<std::string>({"auth /user ", "show /user/5 5", "sub  ", "named /user/5 5",
+                                      "default /user/5 /user/5", "late /user/5 5"}));
+}
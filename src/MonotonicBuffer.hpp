@@ -0,0 +1,251 @@
+/*
+ * MonotonicBuffer.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+
+#ifndef MONOTONICBUFFER_HPP_INCLUDED
+#define MONOTONICBUFFER_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace HttpUtils
+{
+
+/**
+ * Buffer which hands out memory that stays valid until the buffer is
+ * destroyed or released. Nothing is ever freed individually. The first
+ * allocations are served from an inline block, larger demands from heap
+ * blocks.
+ */
+class MonotonicBuffer
+{
+public:
+
+    MonotonicBuffer()
+        : current_(initial_)
+        , remaining_(sizeof(initial_))
+        , blockSize_(0)
+        , blocks_()
+    {
+    }
+
+    void * allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+    {
+        std::size_t padding = alignmentPadding(current_, alignment);
+        if (padding + size > remaining_)
+        {
+            addBlock(size + alignment);
+            padding = alignmentPadding(current_, alignment);
+        }
+        char *result = current_ + padding;
+        current_ = result + size;
+        remaining_ -= padding + size;
+        return result;
+    }
+
+    char * allocateChars(std::size_t size)
+    {
+        return static_cast<char *>(allocate(size, 1));
+    }
+
+    /**
+     * Invalidate all memory handed out so far. Only the largest heap block
+     * is kept and used for the next allocations, so that a reused buffer
+     * stops allocating once it has grown to the size it needs.
+     */
+    void release()
+    {
+        if (blocks_.empty())
+        {
+            current_ = initial_;
+            remaining_ = sizeof(initial_);
+            return;
+        }
+        if (blocks_.size() > 1)
+        {
+            blocks_.front().swap(blocks_.back());
+            blocks_.resize(1);
+        }
+        current_ = blocks_.front().get();
+        remaining_ = blockSize_;
+    }
+
+private:
+    MonotonicBuffer(const MonotonicBuffer &) = delete;
+    MonotonicBuffer & operator=(const MonotonicBuffer &) = delete;
+
+    static std::size_t alignmentPadding(const char *ptr, std::size_t alignment)
+    {
+        return (alignment - reinterpret_cast<std::uintptr_t>(ptr) % alignment) % alignment;
+    }
+
+    void addBlock(std::size_t minSize)
+    {
+        std::size_t size = blocks_.empty() ? 4 * sizeof(initial_) : 2 * blockSize_;
+        while (size < minSize)
+            size *= 2;
+        blocks_.emplace_back(new char[size]);
+        blockSize_ = size;
+        current_ = blocks_.back().get();
+        remaining_ = size;
+    }
+
+    alignas(std::max_align_t) char initial_[256];
+    char *current_;
+    std::size_t remaining_;
+    std::size_t blockSize_;
+    std::vector< std::unique_ptr<char[]> > blocks_;
+};
+
+/**
+ * Standard allocator which allocates from a MonotonicBuffer. Deallocation
+ * does nothing, the memory is reclaimed when the buffer is released.
+ * A default-constructed allocator has no buffer and uses the global heap.
+ */
+template <class T>
+class MonotonicAllocator
+{
+public:
+    typedef T value_type;
+
+    MonotonicAllocator()
+        : buffer_(0)
+    {
+    }
+
+    explicit MonotonicAllocator(MonotonicBuffer &buffer)
+        : buffer_(&buffer)
+    {
+    }
+
+    template <class U>
+    MonotonicAllocator(const MonotonicAllocator<U> &other)
+        : buffer_(other.buffer())
+    {
+    }
+
+    T * allocate(std::size_t n)
+    {
+        if (!buffer_)
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        return static_cast<T *>(buffer_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *ptr, std::size_t)
+    {
+        if (!buffer_)
+            ::operator delete(ptr);
+    }
+
+    /** The buffer, or null for the global heap */
+    MonotonicBuffer * buffer() const
+    {
+        return buffer_;
+    }
+
+    template <class U>
+    struct rebind
+    {
+        typedef MonotonicAllocator<U> other;
+    };
+
+private:
+    MonotonicBuffer *buffer_;
+};
+
+template <class T, class U>
+inline bool operator==(const MonotonicAllocator<T> &a, const MonotonicAllocator<U> &b)
+{
+    return a.buffer() == b.buffer();
+}
+
+template <class T, class U>
+inline bool operator!=(const MonotonicAllocator<T> &a, const MonotonicAllocator<U> &b)
+{
+    return !(a == b);
+}
+
+/**
+ * Free list of buffers. A buffer is taken from the pool with a Lease and
+ * released and put back when the lease ends, so that its heap blocks are
+ * reused by the next lease. The pool is not thread-safe, use one per
+ * thread.
+ */
+class MonotonicBufferPool
+{
+public:
+
+    /** Maximum number of idle buffers kept by the pool */
+    static const std::size_t MAX_IDLE = 8;
+
+    class Lease
+    {
+    public:
+
+        explicit Lease(MonotonicBufferPool &pool)
+            : pool_(pool)
+            , buffer_(pool.acquire())
+        {
+        }
+
+        ~Lease()
+        {
+            pool_.recycle(std::move(buffer_));
+        }
+
+        MonotonicBuffer & operator*() const { return *buffer_; }
+
+        MonotonicBuffer * operator->() const { return buffer_.get(); }
+
+    private:
+        Lease(const Lease &) = delete;
+        Lease & operator=(const Lease &) = delete;
+
+        MonotonicBufferPool &pool_;
+        std::unique_ptr<MonotonicBuffer> buffer_;
+    };
+
+    MonotonicBufferPool()
+        : idle_()
+    {
+    }
+
+    std::size_t idle() const
+    {
+        return idle_.size();
+    }
+
+private:
+    MonotonicBufferPool(const MonotonicBufferPool &) = delete;
+    MonotonicBufferPool & operator=(const MonotonicBufferPool &) = delete;
+
+    std::unique_ptr<MonotonicBuffer> acquire()
+    {
+        if (idle_.empty())
+            return std::unique_ptr<MonotonicBuffer>(new MonotonicBuffer);
+        std::unique_ptr<MonotonicBuffer> buffer(std::move(idle_.back()));
+        idle_.pop_back();
+        return buffer;
+    }
+
+    void recycle(std::unique_ptr<MonotonicBuffer> &&buffer)
+    {
+        if (idle_.size() < MAX_IDLE)
+        {
+            buffer->release();
+            idle_.push_back(std::move(buffer));
+        }
+    }
+
+    std::vector< std::unique_ptr<MonotonicBuffer> > idle_;
+};
+
+} // namespace HttpUtils
+
+#endif /* MONOTONICBUFFER_HPP_INCLUDED */
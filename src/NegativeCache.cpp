@@ -0,0 +1,78 @@
+/*
+ * NegativeCache.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+#include "NegativeCache.hpp"
+#include "RouteTable.hpp"
+#include <cstring>
+
+namespace HttpUtils
+{
+
+NegativeCache::NegativeCache()
+    : slots_()
+    , generation_(0)
+{
+}
+
+std::uint64_t NegativeCache::hash(const std::string &method, const char *first, const char *last)
+{
+    return RouteTable::hash(first, last) ^ (RouteTable::hash(method.data(), method.data() + method.size()) * 31);
+}
+
+void NegativeCache::reset(std::uint64_t generation, std::size_t capacity)
+{
+    std::size_t size = capacity != 0 ? WAYS : 0;
+    while (size < capacity)
+        size *= 2;
+
+    generation_ = generation;
+    slots_.resize(size);
+    for (std::vector<Slot>::iterator it = slots_.begin(), et = slots_.end(); it != et; ++it)
+        it->used = false;
+}
+
+bool NegativeCache::contains(const std::string &method, const char *first, const char *last) const
+{
+    if (slots_.empty())
+        return false;
+
+    const std::uint64_t h = hash(method, first, last);
+    const std::size_t length = last - first;
+    for (std::size_t i = set(h), n = i + WAYS; i < n; ++i)
+    {
+        const Slot &slot = slots_[i];
+        if (slot.used && slot.hash == h && slot.method == method &&
+            slot.path.size() == length && std::memcmp(slot.path.data(), first, length) == 0)
+            return true;
+    }
+    return false;
+}
+
+void NegativeCache::insert(const std::string &method, const char *first, const char *last)
+{
+    if (slots_.empty())
+        return;
+
+    const std::uint64_t h = hash(method, first, last);
+    const std::size_t base = set(h);
+    // An unused slot of the set, otherwise one chosen by the upper bits of the hash.
+    std::size_t victim = base + (h >> 62) % WAYS;
+    for (std::size_t i = base, n = i + WAYS; i < n; ++i)
+    {
+        if (!slots_[i].used)
+        {
+            victim = i;
+            break;
+        }
+    }
+    Slot &slot = slots_[victim];
+    slot.hash = h;
+    slot.method = method;
+    slot.path.assign(first, last);
+    slot.used = true;
+}
+
+} // namespace HttpUtils
@@ -0,0 +1,74 @@
+/*
+ * NegativeCache.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+
+#ifndef NEGATIVECACHE_HPP_INCLUDED
+#define NEGATIVECACHE_HPP_INCLUDED
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace HttpUtils
+{
+
+/**
+ * Bounded set of recently seen (method, path) pairs which matched no route
+ * except catch-all routes. HttpRouter keeps a CacheSet of them per thread.
+ *
+ * The cache is 4-way set associative: a pair may be stored in one of four
+ * slots selected by its hash and replaces one of them when all are used,
+ * so memory stays fixed and a lookup compares at most four hashes. All
+ * entries belong to one generation of a route table; reset() drops them
+ * when a different generation is used.
+ */
+class NegativeCache
+{
+public:
+
+    NegativeCache();
+
+    std::uint64_t generation() const { return generation_; }
+
+    std::size_t capacity() const { return slots_.size(); }
+
+    /**
+     * Drop all entries and use the cache for another generation.
+     *
+     * @param  generation  generation of the route table
+     * @param  capacity    number of entries, rounded up to a power of two of at least WAYS, 0 disables the cache
+     */
+    void reset(std::uint64_t generation, std::size_t capacity);
+
+    bool contains(const std::string &method, const char *first, const char *last) const;
+
+    void insert(const std::string &method, const char *first, const char *last);
+
+    static const std::size_t WAYS = 4;
+
+private:
+
+    struct Slot
+    {
+        std::uint64_t hash;
+        std::string method;
+        std::string path;
+        bool used;
+    };
+
+    static std::uint64_t hash(const std::string &method, const char *first, const char *last);
+
+    /** First slot of the set of the hash */
+    std::size_t set(std::uint64_t hash) const { return (hash * WAYS) & (slots_.size() - 1); }
+
+    std::vector<Slot> slots_;
+    std::uint64_t generation_;
+};
+
+} // namespace HttpUtils
+
+#endif /* NEGATIVECACHE_HPP_INCLUDED */
@@ -0,0 +1,140 @@
+/*
+ * ParamTraits.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+#include "ParamTraits.hpp"
+
+namespace HttpUtils
+{
+
+namespace
+{
+
+/** Whether c has a special meaning in a pattern */
+bool isSpecial(char c)
+{
+    return std::strchr("\\^$.|?*+()[]{}", c) != 0;
+}
+
+bool equalsIgnoreCase(const char *a, const char *b, std::size_t size)
+{
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z')
+            x = static_cast<char>(x - 'A' + 'a');
+        if (y >= 'A' && y <= 'Z')
+            y = static_cast<char>(y - 'A' + 'a');
+        if (x != y)
+            return false;
+    }
+    return true;
+}
+
+} // unnamed namespace
+
+ParamFormat paramFormat(const std::string &pattern)
+{
+    std::size_t pos;
+    if (pattern.compare(0, 2, "\\d") == 0)
+        pos = 2;
+    else if (pattern.compare(0, 5, "[0-9]") == 0)
+        pos = 5;
+    else
+        return PF_ANY;
+
+    // One or more repetitions, greedy or lazy.
+    if (pattern.compare(pos, std::string::npos, "+") == 0 || pattern.compare(pos, std::string::npos, "+?") == 0)
+        return PF_DIGITS;
+    if (pos >= pattern.size() || pattern[pos] != '{')
+        return PF_ANY;
+    const std::size_t close = pattern.find('}', pos);
+    if (close == std::string::npos || (close + 1 != pattern.size() && pattern.compare(close + 1, std::string::npos, "?") != 0))
+        return PF_ANY;
+    const std::size_t minFirst = pos + 1;
+    std::size_t minLast = minFirst;
+    while (minLast < close && pattern[minLast] >= '0' && pattern[minLast] <= '9')
+        ++minLast;
+    if (minLast == minFirst || (minLast != close && pattern[minLast] != ','))
+        return PF_ANY;
+    for (std::size_t i = minLast + 1; i < close; ++i)
+    {
+        if (pattern[i] < '0' || pattern[i] > '9')
+            return PF_ANY;
+    }
+    // At least one digit.
+    return pattern.find_first_not_of('0', minFirst) < minLast ? PF_DIGITS : PF_ANY;
+}
+
+namespace detail
+{
+
+bool parseHexBytes(const char *first, const char *last, std::uint8_t *out, std::size_t size)
+{
+    if (static_cast<std::size_t>(last - first) != 2 * size)
+        return false;
+    for (std::size_t i = 0; i < size; ++i, first += 2)
+    {
+        const int high = hexDigit(first[0]);
+        const int low = hexDigit(first[1]);
+        if (high < 0 || low < 0)
+            return false;
+        out[i] = static_cast<std::uint8_t>(high << 4 | low);
+    }
+    return true;
+}
+
+bool findAlternative(const std::string &pattern, StringRef value, std::size_t &index)
+{
+    if (pattern.find('|') == std::string::npos)
+        return false;
+    for (std::string::const_iterator it = pattern.begin(), et = pattern.end(); it != et; ++it)
+    {
+        if (*it != '|' && isSpecial(*it))
+            return false;
+    }
+
+    // An exact match first, case-insensitive routes also match other cases.
+    for (int ignoreCase = 0; ignoreCase < 2; ++ignoreCase)
+    {
+        std::size_t first = 0;
+        for (std::size_t i = 0;; ++i)
+        {
+            std::size_t last = pattern.find('|', first);
+            if (last == std::string::npos)
+                last = pattern.size();
+            const std::size_t size = last - first;
+            if (size == value.size() &&
+                (ignoreCase ? equalsIgnoreCase(pattern.data() + first, value.data(), size)
+                            : std::memcmp(pattern.data() + first, value.data(), size) == 0))
+            {
+                index = i;
+                return true;
+            }
+            if (last == pattern.size())
+                break;
+            first = last + 1;
+        }
+    }
+    return false;
+}
+
+} // namespace detail
+
+bool ParamTraits<Uuid>::parse(StringRef value, const PathKey &, ParamFormat, Uuid &result)
+{
+    const char *s = value.data();
+    if (value.size() == 32)
+        return detail::parseHexBytes(s, s + 32, result.bytes, 16);
+    if (value.size() != 36 || s[8] != '-' || s[13] != '-' || s[18] != '-' || s[23] != '-')
+        return false;
+    return detail::parseHexBytes(s, s + 8, result.bytes, 4) &&
+           detail::parseHexBytes(s + 9, s + 13, result.bytes + 4, 2) &&
+           detail::parseHexBytes(s + 14, s + 18, result.bytes + 6, 2) &&
+           detail::parseHexBytes(s + 19, s + 23, result.bytes + 8, 2) &&
+           detail::parseHexBytes(s + 24, s + 36, result.bytes + 10, 6);
+}
+
+} // namespace HttpUtils
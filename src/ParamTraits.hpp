@@ -0,0 +1,260 @@
+/*
+ * ParamTraits.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+
+#ifndef PARAMTRAITS_HPP_INCLUDED
+#define PARAMTRAITS_HPP_INCLUDED
+
+#include "PathToRegexp.hpp"
+#include "UriUtils.hpp"
+#include <string>
+#include <limits>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace HttpUtils
+{
+
+/**
+ * Characters of the parameter values which the pattern of a key admits,
+ * see paramFormat().
+ */
+enum ParamFormat
+{
+    /** Any characters, values are percent-decoded and validated */
+    PF_ANY,
+    /** One or more decimal digits */
+    PF_DIGITS
+};
+
+/**
+ * Format which every value matched by pattern has, e.g. PF_DIGITS for
+ * `\d+` or `[0-9]{4}`. Conversions skip the checks the format implies.
+ *
+ * @param  pattern  pattern of a key which does not repeat
+ * @return format
+ */
+ParamFormat paramFormat(const std::string &pattern);
+
+/** UUID such as `123e4567-e89b-12d3-a456-426614174000` */
+struct Uuid
+{
+    std::uint8_t bytes[16];
+};
+
+inline bool operator==(const Uuid &a, const Uuid &b)
+{
+    return std::memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0;
+}
+
+inline bool operator!=(const Uuid &a, const Uuid &b)
+{
+    return !(a == b);
+}
+
+/** Identifier of N bytes written as 2 * N hexadecimal digits */
+template <std::size_t N>
+struct HexId
+{
+    std::uint8_t bytes[N];
+};
+
+template <std::size_t N>
+inline bool operator==(const HexId<N> &a, const HexId<N> &b)
+{
+    return std::memcmp(a.bytes, b.bytes, N) == 0;
+}
+
+template <std::size_t N>
+inline bool operator!=(const HexId<N> &a, const HexId<N> &b)
+{
+    return !(a == b);
+}
+
+namespace detail
+{
+
+/** Value of a hexadecimal digit or -1 */
+inline int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+/**
+ * Parse exactly 2 * size hexadecimal digits into size bytes.
+ *
+ * @return false if [first, last) has a different length or other characters
+ */
+bool parseHexBytes(const char *first, const char *last, std::uint8_t *out, std::size_t size);
+
+/**
+ * Parse a decimal number without sign for the integer type T. When digits
+ * is true every character is known to be a digit.
+ *
+ * @param  limit  greatest accepted value, at least the maximum of T
+ * @return false if the range is empty, contains other characters or the
+ *         value is greater than limit
+ */
+template <class T, class U>
+bool parseDecimal(const char *first, const char *last, bool digits, U limit, U &result)
+{
+    if (first == last)
+        return false;
+    U value = 0;
+    if (digits && last - first <= std::numeric_limits<T>::digits10)
+    {
+        // Neither other characters nor an overflow are possible.
+        for (; first != last; ++first)
+            value = static_cast<U>(value * 10 + (*first - '0'));
+    }
+    else
+    {
+        for (; first != last; ++first)
+        {
+            const unsigned d = static_cast<unsigned char>(*first) - '0';
+            if (d > 9 || value > (limit - d) / 10)
+                return false;
+            value = static_cast<U>(value * 10 + d);
+        }
+    }
+    result = value;
+    return true;
+}
+
+/**
+ * Position of value among the alternatives of an alternation of literals
+ * such as `photo|video`, compared without case if no alternative is equal.
+ *
+ * @return false if pattern is not an alternation of literals or value is none of them
+ */
+bool findAlternative(const std::string &pattern, StringRef value, std::size_t &index);
+
+} // namespace detail
+
+/**
+ * Conversion of a route parameter to T, see HttpRouter::Context::param().
+ * Specializations provide
+ *
+ *     static bool parse(StringRef value, const PathKey &key, ParamFormat format, T &result);
+ *
+ * which returns false if value is not a valid T. value is percent-decoded
+ * unless format is PF_DIGITS.
+ */
+template <class T, class Enable = void>
+struct ParamTraits;
+
+/** Decimal integers, negative ones with a leading `-` */
+template <class T>
+struct ParamTraits<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+{
+    typedef typename std::make_unsigned<T>::type U;
+
+    static bool parse(StringRef value, const PathKey &, ParamFormat format, T &result)
+    {
+        const char *first = value.data();
+        const char *last = first + value.size();
+        U magnitude;
+        if (std::is_signed<T>::value && first != last && *first == '-')
+        {
+            const U limit = static_cast<U>(std::numeric_limits<T>::max()) + 1;
+            if (!detail::parseDecimal<T>(first + 1, last, false, limit, magnitude))
+                return false;
+            result = static_cast<T>(0 - magnitude);
+            return true;
+        }
+        if (!detail::parseDecimal<T>(first, last, format == PF_DIGITS, static_cast<U>(std::numeric_limits<T>::max()), magnitude))
+            return false;
+        result = static_cast<T>(magnitude);
+        return true;
+    }
+};
+
+/** `true`, `false`, `1` or `0` */
+template <>
+struct ParamTraits<bool>
+{
+    static bool parse(StringRef value, const PathKey &, ParamFormat, bool &result)
+    {
+        if (value == "true" || value == "1")
+            result = true;
+        else if (value == "false" || value == "0")
+            result = false;
+        else
+            return false;
+        return true;
+    }
+};
+
+template <>
+struct ParamTraits<StringRef>
+{
+    static bool parse(StringRef value, const PathKey &, ParamFormat, StringRef &result)
+    {
+        result = value;
+        return true;
+    }
+};
+
+template <>
+struct ParamTraits<std::string>
+{
+    static bool parse(StringRef value, const PathKey &, ParamFormat, std::string &result)
+    {
+        result.assign(value.data(), value.size());
+        return true;
+    }
+};
+
+/** UUID with or without dashes, in upper or lower case */
+template <>
+struct ParamTraits<Uuid>
+{
+    static bool parse(StringRef value, const PathKey &, ParamFormat, Uuid &result);
+};
+
+template <std::size_t N>
+struct ParamTraits<HexId<N> >
+{
+    static bool parse(StringRef value, const PathKey &, ParamFormat, HexId<N> &result)
+    {
+        return detail::parseHexBytes(value.data(), value.data() + value.size(), result.bytes, N);
+    }
+};
+
+/**
+ * Enumerations. If the pattern of the key is an alternation of literals,
+ * e.g. `:kind(photo|video)`, the value is the position of the matched
+ * literal, otherwise the parameter is converted as an integer.
+ */
+template <class T>
+struct ParamTraits<T, typename std::enable_if<std::is_enum<T>::value>::type>
+{
+    typedef typename std::underlying_type<T>::type Integer;
+
+    static bool parse(StringRef value, const PathKey &key, ParamFormat format, T &result)
+    {
+        std::size_t index;
+        if (detail::findAlternative(key.pattern, value, index))
+        {
+            result = static_cast<T>(index);
+            return true;
+        }
+        Integer integer;
+        if (!ParamTraits<Integer>::parse(value, key, format, integer))
+            return false;
+        result = static_cast<T>(integer);
+        return true;
+    }
+};
+
+} // namespace HttpUtils
+
+#endif /* PARAMTRAITS_HPP_INCLUDED */
@@ -0,0 +1,1034 @@
+/*
+ * PathMatcher.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+#include "PathMatcher.hpp"
+#include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace HttpUtils
+{
+
+namespace detail
+{
+
+typedef PathValidator::CharSet CharSet;
+
+bool addEscapeToSet(char c, CharSet &set)
+{
+    CharSet cls;
+    bool negate = false;
+    switch (c)
+    {
+        case 'D': negate = true; // fall through
+        case 'd':
+            for (int i = '0'; i <= '9'; ++i) cls.set(i);
+            break;
+        case 'W': negate = true; // fall through
+        case 'w':
+            for (int i = '0'; i <= '9'; ++i) cls.set(i);
+            for (int i = 'a'; i <= 'z'; ++i) cls.set(i);
+            for (int i = 'A'; i <= 'Z'; ++i) cls.set(i);
+            cls.set('_');
+            break;
+        case 'S': negate = true; // fall through
+        case 's':
+            cls.set(' '); cls.set('\t'); cls.set('\n'); cls.set('\r'); cls.set('\v'); cls.set('\f');
+            break;
+        default:
+            return false;
+    }
+    set |= negate ? ~cls : cls;
+    return true;
+}
+
+bool escapedChar(char c, char &result)
+{
+    switch (c)
+    {
+        case 't': result = '\t'; return true;
+        case 'n': result = '\n'; return true;
+        case 'r': result = '\r'; return true;
+        case 'f': result = '\f'; return true;
+        case 'v': result = '\v'; return true;
+    }
+    if (::isalnum(static_cast<unsigned char>(c)))
+        return false;
+    result = c;
+    return true;
+}
+
+bool parseBracket(const std::string &p, std::size_t &pos, CharSet &set)
+{
+    CharSet cls;
+    const bool negate = pos < p.size() && p[pos] == '^';
+    if (negate)
+        ++pos;
+
+    while (pos < p.size() && p[pos] != ']')
+    {
+        char first = p[pos++];
+        if (first == '\\')
+        {
+            if (pos == p.size())
+                return false;
+            const char e = p[pos++];
+            if (addEscapeToSet(e, cls))
+                continue;
+            if (!escapedChar(e, first))
+                return false;
+        }
+
+        char last = first;
+        if (pos + 1 < p.size() && p[pos] == '-' && p[pos + 1] != ']')
+        {
+            ++pos;
+            last = p[pos++];
+            if (last == '\\')
+            {
+                if (pos == p.size() || !escapedChar(p[pos++], last))
+                    return false;
+            }
+            if (static_cast<unsigned char>(last) < static_cast<unsigned char>(first))
+                return false;
+        }
+
+        for (int c = static_cast<unsigned char>(first); c <= static_cast<unsigned char>(last); ++c)
+            cls.set(c);
+    }
+
+    if (pos == p.size())
+        return false;
+    ++pos; // skip ']'
+
+    set = negate ? ~cls : cls;
+    return true;
+}
+
+} // namespace detail
+
+namespace
+{
+
+/** Upper bound for the size of a compiled program, larger patterns use std::regex */
+static const std::size_t MAX_PROGRAM_SIZE = 4096;
+
+static const int INFINITE_REPEAT = -1;
+
+inline char foldAscii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+inline bool isAsciiAlpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/** Add the other case of every ASCII letter in the set */
+void foldCharSet(PathValidator::CharSet &set)
+{
+    for (int c = 'a'; c <= 'z'; ++c)
+    {
+        if (set[c] || set[c - 'a' + 'A'])
+        {
+            set.set(c);
+            set.set(c - 'a' + 'A');
+        }
+    }
+}
+
+/** Compare with a literal which is folded to lower case when icase is set */
+inline bool matchLiteral(const char *pos, const std::string &literal, bool icase)
+{
+    if (!icase)
+        return std::memcmp(pos, literal.data(), literal.size()) == 0;
+    for (std::size_t i = 0, sz = literal.size(); i < sz; ++i)
+    {
+        if (foldAscii(pos[i]) != literal[i])
+            return false;
+    }
+    return true;
+}
+
+std::string foldString(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(), foldAscii);
+    return str;
+}
+
+/**
+ * Estimate the worst case of a backtracking matcher for the regular
+ * expression: every unbounded quantifier in a sequence multiplies the
+ * number of ways to split the input by n, an unbounded quantifier over an
+ * expression containing one makes it exponential.
+ */
+void estimateBacktracking(const std::string &re, unsigned &degree, bool &exponential)
+{
+    struct Frame
+    {
+        unsigned sequence;
+        unsigned alternatives;
+    };
+    std::vector<Frame> frames(1, Frame());
+    unsigned atom = 0;
+    exponential = false;
+
+    for (std::size_t pos = 0, sz = re.size(); pos < sz; ++pos)
+    {
+        bool unbounded = false;
+        switch (re[pos])
+        {
+            case '\\':
+                ++pos;
+                atom = 0;
+                break;
+            case '[':
+                if (pos + 1 < sz && re[pos + 1] == '^')
+                    ++pos;
+                if (pos + 1 < sz && re[pos + 1] == ']')
+                    ++pos;
+                while (++pos < sz && re[pos] != ']')
+                {
+                    if (re[pos] == '\\')
+                        ++pos;
+                }
+                atom = 0;
+                break;
+            case '(':
+                frames.push_back(Frame());
+                if (pos + 1 < sz && re[pos + 1] == '?')
+                    pos += 2;
+                break;
+            case ')':
+                if (frames.size() > 1)
+                {
+                    const Frame group = frames.back();
+                    frames.pop_back();
+                    atom = std::max(group.sequence, group.alternatives);
+                    frames.back().sequence += atom;
+                }
+                break;
+            case '|':
+                frames.back().alternatives = std::max(frames.back().alternatives, frames.back().sequence);
+                frames.back().sequence = 0;
+                break;
+            case '*':
+            case '+':
+                unbounded = true;
+                break;
+            case '{':
+            {
+                const std::size_t close = re.find('}', pos);
+                if (close == std::string::npos)
+                {
+                    atom = 0;
+                    break;
+                }
+                unbounded = re[close - 1] == ',';
+                pos = close;
+                break;
+            }
+            case '?':
+                break;
+            default:
+                atom = 0;
+        }
+        if (unbounded)
+        {
+            if (atom > 0)
+                exponential = true;
+            ++atom;
+            ++frames.back().sequence;
+        }
+    }
+    degree = std::max(frames.front().sequence, frames.front().alternatives);
+}
+
+} // unnamed namespace
+
+/**
+ * Compiles routes and key patterns into programs.
+ *
+ * Programs are built from fragments whose jump targets are relative to the
+ * beginning of the fragment, a target equal to the fragment size continues
+ * after the fragment.
+ */
+class PathMatcher::Compiler
+{
+public:
+
+    Compiler(PathMatcher &matcher, bool icase)
+        : matcher_(matcher)
+        , icase_(icase)
+        , pattern_(0)
+        , pos_(0)
+    {
+    }
+
+    void literal(const std::string &str, Program &out)
+    {
+        for (std::string::const_iterator it = str.begin(), et = str.end(); it != et; ++it)
+            emitChar(*it, out);
+    }
+
+    bool key(const PathKey &key, Program &out)
+    {
+        Program prefix;
+        literal(key.prefix, prefix);
+
+        const int group = static_cast<int>(++matcher_.groups_);
+        Program capture;
+        if (key.repeat)
+        {
+            // Spelled like tokensToRegExp(), `pattern(?:prefix pattern)*`, so
+            // that an alternation in the pattern extends over the repetition.
+            std::string repeated = key.pattern + "(?:";
+            for (std::string::const_iterator it = key.prefix.begin(), et = key.prefix.end(); it != et; ++it)
+            {
+                if (!::isalnum(static_cast<unsigned char>(*it)))
+                    repeated += '\\';
+                repeated += *it;
+            }
+            repeated += key.pattern + ")*";
+            if (!pattern(repeated, capture))
+                return false;
+        }
+        else if (!pattern(key.pattern, capture))
+        {
+            return false;
+        }
+
+        capture = groupOf(capture, group);
+
+        if (key.optional)
+        {
+            // (?:prefix(capture))? or (capture)?
+            append(prefix, capture);
+            append(out, quest(prefix, true));
+        }
+        else
+        {
+            append(out, prefix);
+            append(out, capture);
+        }
+        return out.size() <= MAX_PROGRAM_SIZE;
+    }
+
+    static Instruction make(Opcode op, int x = 0, int y = 0, char c = 0)
+    {
+        Instruction ins;
+        ins.op = static_cast<unsigned char>(op);
+        ins.c = static_cast<unsigned char>(c);
+        ins.x = x;
+        ins.y = y;
+        return ins;
+    }
+
+    static void append(Program &out, const Program &fragment)
+    {
+        const int offset = static_cast<int>(out.size());
+        for (Program::const_iterator it = fragment.begin(), et = fragment.end(); it != et; ++it)
+        {
+            Instruction ins = *it;
+            if (ins.op == OP_SPLIT || ins.op == OP_JMP)
+            {
+                ins.x += offset;
+                ins.y += offset;
+            }
+            out.push_back(ins);
+        }
+    }
+
+    static Program alternate(const Program &a, const Program &b)
+    {
+        const int sa = static_cast<int>(a.size());
+        const int sb = static_cast<int>(b.size());
+        Program r(1, make(OP_SPLIT, 1, sa + 2));
+        append(r, a);
+        r.push_back(make(OP_JMP, sa + 2 + sb));
+        append(r, b);
+        return r;
+    }
+
+    static Program star(const Program &a, bool greedy)
+    {
+        const int sa = static_cast<int>(a.size());
+        Program r(1, greedy ? make(OP_SPLIT, 1, sa + 2) : make(OP_SPLIT, sa + 2, 1));
+        append(r, a);
+        r.push_back(make(OP_JMP, 0));
+        return r;
+    }
+
+    static Program plus(const Program &a, bool greedy)
+    {
+        const int sa = static_cast<int>(a.size());
+        Program r(a);
+        r.push_back(greedy ? make(OP_SPLIT, 0, sa + 1) : make(OP_SPLIT, sa + 1, 0));
+        return r;
+    }
+
+    static Program quest(const Program &a, bool greedy)
+    {
+        const int sa = static_cast<int>(a.size());
+        Program r(1, greedy ? make(OP_SPLIT, 1, sa + 1) : make(OP_SPLIT, sa + 1, 1));
+        append(r, a);
+        return r;
+    }
+
+    static Program groupOf(const Program &a, int group)
+    {
+        Program r(1, make(OP_SAVE, 2 * group));
+        append(r, a);
+        r.push_back(make(OP_SAVE, 2 * group + 1));
+        return r;
+    }
+
+private:
+
+    /** Parse a key pattern as a whole */
+    bool pattern(const std::string &p, Program &out)
+    {
+        pattern_ = &p;
+        pos_ = 0;
+        return parseAlternative(out) && pos_ == p.size();
+    }
+
+    bool atEnd() const { return pos_ == pattern_->size(); }
+
+    char peek() const { return (*pattern_)[pos_]; }
+
+    bool parseAlternative(Program &out)
+    {
+        if (!parseConcat(out))
+            return false;
+        while (!atEnd() && peek() == '|')
+        {
+            ++pos_;
+            Program other;
+            if (!parseConcat(other))
+                return false;
+            out = alternate(out, other);
+        }
+        return out.size() <= MAX_PROGRAM_SIZE;
+    }
+
+    bool parseConcat(Program &out)
+    {
+        while (!atEnd() && peek() != '|' && peek() != ')')
+        {
+            Program atom;
+            bool assertion = false;
+            if (!parseAtom(atom, assertion) || !parseQuantifier(atom, assertion))
+                return false;
+            append(out, atom);
+            if (out.size() > MAX_PROGRAM_SIZE)
+                return false;
+        }
+        return true;
+    }
+
+    bool parseAtom(Program &out, bool &assertion)
+    {
+        const std::string &p = *pattern_;
+        const char c = p[pos_++];
+        CharSet set;
+        switch (c)
+        {
+            case '(':
+            {
+                int group = -1;
+                if (!atEnd() && peek() == '?')
+                {
+                    // Only non-capturing groups, no lookarounds.
+                    if (pos_ + 1 >= p.size() || p[pos_ + 1] != ':')
+                        return false;
+                    pos_ += 2;
+                }
+                else
+                {
+                    group = static_cast<int>(++matcher_.groups_);
+                }
+                Program inner;
+                if (!parseAlternative(inner) || atEnd() || peek() != ')')
+                    return false;
+                ++pos_;
+                out = group < 0 ? inner : groupOf(inner, group);
+                return true;
+            }
+            case '[':
+                if (!detail::parseBracket(p, pos_, set))
+                    return false;
+                emitClass(set, out);
+                return true;
+            case '.':
+                set.set();
+                set.reset('\n');
+                set.reset('\r');
+                emitClass(set, out);
+                return true;
+            case '^':
+                assertion = true;
+                out.push_back(make(OP_ASSERT_BEGIN));
+                return true;
+            case '$':
+                assertion = true;
+                out.push_back(make(OP_ASSERT_END));
+                return true;
+            case '\\':
+            {
+                if (atEnd())
+                    return false;
+                const char e = p[pos_++];
+                char lit;
+                if (detail::addEscapeToSet(e, set))
+                {
+                    emitClass(set, out);
+                    return true;
+                }
+                // Back-references and word boundaries are rejected here.
+                if (!detail::escapedChar(e, lit))
+                    return false;
+                emitChar(lit, out);
+                return true;
+            }
+            case ')': case '*': case '+': case '?': case '{': case '}': case ']': case '|':
+                return false;
+        }
+        emitChar(c, out);
+        return true;
+    }
+
+    bool parseNumber(int &value)
+    {
+        const std::string &p = *pattern_;
+        if (atEnd() || !::isdigit(static_cast<unsigned char>(p[pos_])))
+            return false;
+        value = 0;
+        while (!atEnd() && ::isdigit(static_cast<unsigned char>(p[pos_])))
+        {
+            value = value * 10 + (p[pos_++] - '0');
+            if (value > static_cast<int>(MAX_PROGRAM_SIZE))
+                return false;
+        }
+        return true;
+    }
+
+    bool parseQuantifier(Program &atom, bool assertion)
+    {
+        if (atEnd())
+            return true;
+
+        int min = 0;
+        int max = INFINITE_REPEAT;
+        switch (peek())
+        {
+            case '*': ++pos_; break;
+            case '+': ++pos_; min = 1; break;
+            case '?': ++pos_; max = 1; break;
+            case '{':
+                ++pos_;
+                if (!parseNumber(min))
+                    return false;
+                max = min;
+                if (!atEnd() && peek() == ',')
+                {
+                    ++pos_;
+                    max = INFINITE_REPEAT;
+                    if (!atEnd() && peek() != '}' && (!parseNumber(max) || max < min))
+                        return false;
+                }
+                if (atEnd() || peek() != '}')
+                    return false;
+                ++pos_;
+                break;
+            default:
+                return true;
+        }
+
+        if (assertion)
+            return false;
+
+        bool greedy = true;
+        if (!atEnd() && peek() == '?')
+        {
+            greedy = false;
+            ++pos_;
+        }
+
+        Program result;
+        for (int i = 0; i < min; ++i)
+        {
+            append(result, atom);
+            if (result.size() > MAX_PROGRAM_SIZE)
+                return false;
+        }
+
+        if (max == INFINITE_REPEAT)
+        {
+            if (min > 0)
+            {
+                // x{n,} == x{n-1}x+, reusing the last copy of x.
+                result.resize(result.size() - atom.size());
+                append(result, plus(atom, greedy));
+            }
+            else
+            {
+                append(result, star(atom, greedy));
+            }
+        }
+        else
+        {
+            // x{n,m} == x{n}(?:x(?:x...)?)?
+            Program tail;
+            for (int i = min; i < max; ++i)
+            {
+                Program optional = atom;
+                append(optional, tail);
+                tail = quest(optional, greedy);
+                if (tail.size() > MAX_PROGRAM_SIZE)
+                    return false;
+            }
+            append(result, tail);
+        }
+
+        atom.swap(result);
+        return atom.size() <= MAX_PROGRAM_SIZE;
+    }
+
+    void emitChar(char c, Program &out)
+    {
+        if (icase_ && isAsciiAlpha(c))
+            out.push_back(make(OP_CHAR_ICASE, 0, 0, foldAscii(c)));
+        else
+            out.push_back(make(OP_CHAR, 0, 0, c));
+    }
+
+    void emitClass(CharSet set, Program &out)
+    {
+        if (icase_)
+            foldCharSet(set);
+        int index = static_cast<int>(matcher_.classes_.size());
+        for (std::size_t i = 0; i < matcher_.classes_.size(); ++i)
+        {
+            if (matcher_.classes_[i] == set)
+            {
+                index = static_cast<int>(i);
+                break;
+            }
+        }
+        if (index == static_cast<int>(matcher_.classes_.size()))
+            matcher_.classes_.push_back(set);
+        out.push_back(make(OP_CLASS, index));
+    }
+
+    PathMatcher &matcher_;
+    bool icase_;
+    const std::string *pattern_;
+    std::size_t pos_;
+};
+
+void PathMatcher::State::ThreadList::clear()
+{
+    count = 0;
+    if (++generation == 0)
+    {
+        std::fill(marks.begin(), marks.end(), 0);
+        generation = 1;
+    }
+}
+
+PathMatcher::State::State()
+    : initial_()
+{
+    for (ThreadList &list : lists_)
+    {
+        list.count = 0;
+        list.captureSize = 0;
+        list.generation = 0;
+    }
+}
+
+void PathMatcher::State::reserve(std::size_t programSize, std::size_t captureSize)
+{
+    for (ThreadList &list : lists_)
+    {
+        if (list.pcs.size() < programSize)
+        {
+            list.pcs.resize(programSize);
+            list.marks.resize(programSize, 0);
+        }
+        if (list.captures.size() < programSize * captureSize)
+            list.captures.resize(programSize * captureSize);
+    }
+    if (initial_.capacity() < captureSize)
+        initial_.reserve(captureSize);
+}
+
+const std::size_t PathMatcher::npos;
+
+std::string RouteAnalysis::complexity() const
+{
+    if (routeClass != RC_BACKTRACKING || (!exponential && degree <= 1))
+        return "O(n)";
+    if (exponential)
+        return "O(2^n)";
+    return "O(n^" + std::to_string(degree) + ")";
+}
+
+PathMatcher::PathMatcher()
+    : program_()
+    , classes_()
+    , segments_()
+    , prefix_()
+    , groups_(0)
+    , options_(PR_END)
+    , supported_(false)
+    , native_(false)
+    , endsWithSlash_(false)
+{
+}
+
+PathMatcher::PathMatcher(const std::vector<PathToken> &tokens, int options)
+    : program_()
+    , classes_()
+    , segments_()
+    , prefix_()
+    , groups_(0)
+    , options_(options)
+    , supported_(false)
+    , native_(false)
+    , endsWithSlash_(!tokens.empty() && tokens.back().which() == 0 &&
+                     boost::algorithm::ends_with(boost::get<std::string>(tokens.back()), "/"))
+{
+    const bool strict = (options & PR_STRICT) != 0;
+    const bool end = (options & PR_END) != 0;
+    const bool icase = (options & PR_SENSITIVE) == 0;
+    const bool endsWithSlash = endsWithSlash_;
+
+    Compiler compiler(*this, icase);
+    Program route;
+
+    for (std::size_t i = 0, sz = tokens.size(); i < sz; ++i)
+    {
+        const PathToken &token = tokens[i];
+        if (token.which() == 0)
+        {
+            std::string str = boost::get<std::string>(token);
+
+            // In non-strict mode the trailing slash is matched optionally below.
+            if (!strict && endsWithSlash && i + 1 == sz)
+                str.erase(str.size() - 1);
+
+            if (i == 0)
+            {
+                prefix_ = str;
+                if (icase)
+                    std::transform(prefix_.begin(), prefix_.end(), prefix_.begin(), foldAscii);
+            }
+            compiler.literal(str, route);
+        }
+        else if (!compiler.key(boost::get<PathKey>(token), route))
+        {
+            program_.clear();
+            classes_.clear();
+            return;
+        }
+    }
+
+    if (!strict)
+    {
+        // (?:\/(?=$))?
+        Program slash(1, Compiler::make(OP_CHAR, 0, 0, '/'));
+        slash.push_back(Compiler::make(OP_ASSERT_END));
+        Compiler::append(route, Compiler::quest(slash, true));
+    }
+
+    if (end)
+        route.push_back(Compiler::make(OP_ASSERT_END));
+    else if (!(strict && endsWithSlash))
+        route.push_back(Compiler::make(OP_ASSERT_SEGMENT_END));
+
+    Compiler::append(program_, Compiler::groupOf(route, 0));
+    program_.push_back(Compiler::make(OP_MATCH));
+    supported_ = true;
+
+    compileNative(tokens);
+}
+
+void PathMatcher::compileNative(const std::vector<PathToken> &tokens)
+{
+    const bool strict = (options_ & PR_STRICT) != 0;
+    const bool end = (options_ & PR_END) != 0;
+    const bool icase = (options_ & PR_SENSITIVE) == 0;
+
+    std::vector<Segment> segments;
+    Segment segment;
+    segment.group = 0;
+    segment.minLength = 0;
+    std::size_t group = 0;
+    bool lazy = false;
+
+    for (std::size_t i = 0, sz = tokens.size(); i < sz; ++i)
+    {
+        if (tokens[i].which() == 0)
+        {
+            std::string str = boost::get<std::string>(tokens[i]);
+            if (!strict && endsWithSlash_ && i + 1 == sz)
+                str.erase(str.size() - 1);
+            segment.literal += icase ? foldString(str) : str;
+            continue;
+        }
+
+        const PathKey &key = boost::get<PathKey>(tokens[i]);
+        if (key.optional || key.repeat)
+            return;
+
+        const PathValidator validator(key.pattern);
+        if (validator.kind() == PathValidator::PV_CHAR_RUN)
+        {
+            segment.set = validator.charSet();
+            if (icase)
+                foldCharSet(segment.set);
+            segment.minLength = validator.minLength();
+            lazy = !key.pattern.empty() && key.pattern[key.pattern.size() - 1] == '?';
+        }
+        else if (validator.kind() == PathValidator::PV_ALTERNATION)
+        {
+            // At most one alternative may match at any position.
+            segment.alternatives = validator.alternatives();
+            if (icase)
+                std::transform(segment.alternatives.begin(), segment.alternatives.end(),
+                               segment.alternatives.begin(), foldString);
+            for (std::size_t a = 0; a < segment.alternatives.size(); ++a)
+            {
+                if (segment.alternatives[a].empty())
+                    return;
+                for (std::size_t b = 0; b < segment.alternatives.size(); ++b)
+                {
+                    if (a != b && boost::algorithm::starts_with(segment.alternatives[b], segment.alternatives[a]))
+                        return;
+                }
+            }
+        }
+        else
+        {
+            return;
+        }
+
+        segment.literal += icase ? foldString(key.prefix) : key.prefix;
+        segment.group = ++group;
+        segments.push_back(segment);
+
+        segment = Segment();
+        segment.group = 0;
+        segment.minLength = 0;
+    }
+    if (!segment.literal.empty())
+        segments.push_back(segment);
+
+    // A character run must stop at the character which follows it, the
+    // longest run is then the only one which can match. A greedy run at the
+    // end of an ending route may contain '/', it runs to the end of the path
+    // anyway, e.g. `*`.
+    for (std::size_t i = 0, sz = segments.size(); i < sz; ++i)
+    {
+        if (segments[i].group == 0 || !segments[i].alternatives.empty())
+            continue;
+        if (i + 1 < sz)
+        {
+            const std::string &next = segments[i + 1].literal;
+            if (next.empty() || segments[i].set[static_cast<unsigned char>(next[0])])
+                return;
+        }
+        else if (!(strict && end) && !(end && !lazy) && segments[i].set['/'])
+        {
+            return;
+        }
+    }
+
+    segments_.swap(segments);
+    native_ = true;
+}
+
+bool PathMatcher::matchNative(const char *first, const char *last, std::size_t *captures, bool lowercase) const
+{
+    const bool strict = (options_ & PR_STRICT) != 0;
+    const bool icase = (options_ & PR_SENSITIVE) == 0 && !lowercase;
+
+    std::fill(captures, captures + captureSize(), npos);
+    const char *pos = first;
+    for (std::vector<Segment>::const_iterator it = segments_.begin(), et = segments_.end(); it != et; ++it)
+    {
+        const Segment &segment = *it;
+        if (static_cast<std::size_t>(last - pos) < segment.literal.size() ||
+            !matchLiteral(pos, segment.literal, icase))
+            return false;
+        pos += segment.literal.size();
+        if (segment.group == 0)
+            continue;
+
+        const char *start = pos;
+        if (segment.alternatives.empty())
+        {
+            while (pos != last && segment.set[static_cast<unsigned char>(*pos)])
+                ++pos;
+            if (static_cast<std::size_t>(pos - start) < segment.minLength)
+                return false;
+        }
+        else
+        {
+            std::vector<std::string>::const_iterator alt = segment.alternatives.begin();
+            for (; alt != segment.alternatives.end(); ++alt)
+            {
+                if (static_cast<std::size_t>(last - pos) >= alt->size() && matchLiteral(pos, *alt, icase))
+                    break;
+            }
+            if (alt == segment.alternatives.end())
+                return false;
+            pos += alt->size();
+        }
+        captures[2 * segment.group] = start - first;
+        captures[2 * segment.group + 1] = pos - first;
+    }
+
+    if (!strict && pos + 1 == last && *pos == '/')
+        ++pos;
+    if ((options_ & PR_END) != 0)
+    {
+        if (pos != last)
+            return false;
+    }
+    else if (!(strict && endsWithSlash_) && pos != last && *pos != '/')
+    {
+        return false;
+    }
+    captures[0] = 0;
+    captures[1] = pos - first;
+    return true;
+}
+
+void PathMatcher::addThread(ThreadList &list, int pc, const char *first, const char *last,
+                            const char *pos, std::size_t *captures) const
+{
+    if (list.marks[pc] == list.generation)
+        return;
+    list.marks[pc] = list.generation;
+
+    const Instruction &ins = program_[pc];
+    switch (ins.op)
+    {
+        case OP_JMP:
+            addThread(list, ins.x, first, last, pos, captures);
+            return;
+        case OP_SPLIT:
+            addThread(list, ins.x, first, last, pos, captures);
+            addThread(list, ins.y, first, last, pos, captures);
+            return;
+        case OP_SAVE:
+        {
+            const std::size_t saved = captures[ins.x];
+            captures[ins.x] = pos - first;
+            addThread(list, pc + 1, first, last, pos, captures);
+            captures[ins.x] = saved;
+            return;
+        }
+        case OP_ASSERT_BEGIN:
+            if (pos == first)
+                addThread(list, pc + 1, first, last, pos, captures);
+            return;
+        case OP_ASSERT_END:
+            if (pos == last)
+                addThread(list, pc + 1, first, last, pos, captures);
+            return;
+        case OP_ASSERT_SEGMENT_END:
+            if (pos == last || *pos == '/')
+                addThread(list, pc + 1, first, last, pos, captures);
+            return;
+    }
+
+    list.pcs[list.count] = pc;
+    std::copy(captures, captures + list.captureSize, &list.captures[list.count * list.captureSize]);
+    ++list.count;
+}
+
+bool PathMatcher::match(const char *first, const char *last, std::size_t *captures, bool lowercase,
+                        State &state) const
+{
+    if (!supported_)
+        return false;
+    if (native_)
+        return matchNative(first, last, captures, lowercase);
+
+    // Fast rejection by the literal prefix of the route.
+    if (static_cast<std::size_t>(last - first) < prefix_.size() ||
+        !matchLiteral(first, prefix_, (options_ & PR_SENSITIVE) == 0 && !lowercase))
+        return false;
+
+    const std::size_t captureSize = this->captureSize();
+    state.reserve(program_.size(), captureSize);
+    ThreadList *clist = &state.lists_[0];
+    ThreadList *nlist = &state.lists_[1];
+    clist->captureSize = nlist->captureSize = captureSize;
+
+    clist->clear();
+    state.initial_.assign(captureSize, npos);
+    addThread(*clist, 0, first, last, first, state.initial_.data());
+
+    bool matched = false;
+    for (const char *pos = first; clist->count != 0; ++pos)
+    {
+        nlist->clear();
+        for (std::size_t i = 0; i < clist->count; ++i)
+        {
+            const int pc = clist->pcs[i];
+            std::size_t *threadCaptures = &clist->captures[i * captureSize];
+            const Instruction &ins = program_[pc];
+            bool step = false;
+            switch (ins.op)
+            {
+                case OP_CHAR:
+                    step = pos != last && static_cast<unsigned char>(*pos) == ins.c;
+                    break;
+                case OP_CHAR_ICASE:
+                    step = pos != last && static_cast<unsigned char>(lowercase ? *pos : foldAscii(*pos)) == ins.c;
+                    break;
+                case OP_CLASS:
+                    step = pos != last && classes_[ins.x][static_cast<unsigned char>(*pos)];
+                    break;
+                case OP_MATCH:
+                    // Threads with lower priority are cut off.
+                    matched = true;
+                    std::copy(threadCaptures, threadCaptures + captureSize, captures);
+                    i = clist->count;
+                    continue;
+            }
+            if (step)
+                addThread(*nlist, pc + 1, first, last, pos + 1, threadCaptures);
+        }
+        std::swap(clist, nlist);
+        if (pos == last)
+            break;
+    }
+
+    return matched;
+}
+
+RouteAnalysis analyzeRoute(const PathMatcher &matcher, const std::string &regexp)
+{
+    RouteAnalysis analysis;
+    analysis.routeClass = matcher.routeClass();
+    estimateBacktracking(regexp, analysis.degree, analysis.exponential);
+    return analysis;
+}
+
+RouteAnalysis analyzeRoute(const std::vector<PathToken> &tokens, int options)
+{
+    return analyzeRoute(PathMatcher(tokens, options), tokensToRegExp(tokens, options).first);
+}
+
+} // namespace HttpUtils
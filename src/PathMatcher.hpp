@@ -0,0 +1,290 @@
+/*
+ * PathMatcher.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+
+#ifndef PATHMATCHER_HPP_INCLUDED
+#define PATHMATCHER_HPP_INCLUDED
+
+#include "PathToRegexp.hpp"
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace HttpUtils
+{
+
+namespace detail
+{
+
+/**
+ * Add the characters matched by the class escape `\c` (`\d`, `\w`, `\s`
+ * and their complements) to the set.
+ *
+ * @return false if `c` is not a class escape
+ */
+bool addEscapeToSet(char c, PathValidator::CharSet &set);
+
+/**
+ * Decode the single character escape `\c`.
+ *
+ * @return false if `c` starts an escape that denotes more than one fixed character
+ */
+bool escapedChar(char c, char &result);
+
+/**
+ * Parse a bracket expression starting after '[' and advance pos past ']'.
+ *
+ * @return false if the expression is malformed or not supported
+ */
+bool parseBracket(const std::string &p, std::size_t &pos, PathValidator::CharSet &set);
+
+} // namespace detail
+
+/**
+ * Cost class of a route, see analyzeRoute().
+ */
+enum RouteClass
+{
+    /** Literals and simple keys, matched segment by segment in a single pass */
+    RC_NATIVE,
+    /** Matched by the PathMatcher VM in linear time */
+    RC_LINEAR,
+    /** Not supported by PathMatcher, matched by std::regex with backtracking */
+    RC_BACKTRACKING
+};
+
+/**
+ * Result of the analysis of a route.
+ *
+ * degree and exponential estimate the worst case of a backtracking matcher
+ * from the quantifiers of the regular expression: O(n^degree) steps, or
+ * O(2^n) when an unbounded quantifier is applied to an expression which
+ * contains one itself. They only matter for RC_BACKTRACKING routes.
+ */
+struct RouteAnalysis
+{
+    RouteClass routeClass;
+    unsigned degree;
+    bool exponential;
+
+    /** Worst case complexity of matching the route, e.g. `O(n)` or `O(2^n)` */
+    std::string complexity() const;
+};
+
+/**
+ * Route matcher with a guaranteed linear time bound.
+ *
+ * The tokens from parsePath() are compiled with the same semantics as
+ * tokensToRegExp(tokens, options) into a program for a Pike VM, which
+ * runs in O(path length * program size) time and constant stack depth
+ * with respect to the path, regardless of the pattern.
+ *
+ * Key patterns may use literals, `.`, bracket expressions, class escapes,
+ * groups, alternation, `^`, `$` and greedy or lazy quantifiers.
+ * Back-references, lookarounds and word boundaries are not supported;
+ * supported() returns false for such routes and std::regex must be used.
+ */
+class PathMatcher
+{
+public:
+    typedef PathValidator::CharSet CharSet;
+
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    /**
+     * Scratch memory of the VM. A state can be reused for any number of
+     * matches by any matchers, it only grows when a matcher needs more
+     * room than any matcher before. A state must not be shared by threads.
+     */
+    class State
+    {
+    public:
+
+        State();
+
+        /**
+         * Make room for matchers with up to programSize instructions and
+         * captureSize capture slots, see PathMatcher::programSize() and
+         * PathMatcher::captureSize().
+         */
+        void reserve(std::size_t programSize, std::size_t captureSize);
+
+    private:
+        friend class PathMatcher;
+
+        /** Threads of the VM at one input position, in priority order */
+        struct ThreadList
+        {
+            std::vector<int> pcs;
+            std::vector<std::size_t> captures;
+            std::vector<unsigned> marks;
+            std::size_t count;
+            std::size_t captureSize;
+            unsigned generation;
+
+            void clear();
+        };
+
+        ThreadList lists_[2];
+        std::vector<std::size_t> initial_;
+    };
+
+    PathMatcher();
+
+    explicit PathMatcher(const std::vector<PathToken> &tokens, int options = PR_END);
+
+    bool supported() const { return supported_; }
+
+    /**
+     * RC_NATIVE when every key is a run of a character class or an
+     * alternation of literals whose end is unambiguous, RC_LINEAR for
+     * other supported routes and RC_BACKTRACKING otherwise.
+     */
+    RouteClass routeClass() const
+    {
+        return native_ ? RC_NATIVE : (supported_ ? RC_LINEAR : RC_BACKTRACKING);
+    }
+
+    int options() const { return options_; }
+
+    bool caseSensitive() const { return (options_ & PR_SENSITIVE) != 0; }
+
+    /** Number of capture groups, not counting the whole match */
+    std::size_t groupCount() const { return groups_; }
+
+    /** Size of the capture array filled by match(), 2 * (groupCount() + 1) */
+    std::size_t captureSize() const { return 2 * (groups_ + 1); }
+
+    /** Number of VM instructions, 0 for routes which do not run the VM */
+    std::size_t programSize() const { return native_ || !supported_ ? 0 : program_.size(); }
+
+    /**
+     * Match the route against the beginning of [first, last).
+     *
+     * On success captures holds the begin and end offsets of every group
+     * relative to first, group 0 being the whole match. Groups which did
+     * not participate are set to npos.
+     */
+    bool match(const char *first, const char *last, std::size_t *captures) const
+    {
+        State state;
+        return match(first, last, captures, false, state);
+    }
+
+    /**
+     * Same as match(const char *, const char *, std::size_t *), using state
+     * as scratch memory instead of allocating it for this call.
+     */
+    bool match(const char *first, const char *last, std::size_t *captures, State &state) const
+    {
+        return match(first, last, captures, false, state);
+    }
+
+    /**
+     * Same as match() for a path which has already been converted with
+     * asciiToLower(). Case-insensitive routes then compare bytes directly,
+     * the capture offsets are valid for the original path as well.
+     * Must not be used for case-sensitive routes.
+     */
+    bool matchLowercase(const char *first, const char *last, std::size_t *captures) const
+    {
+        State state;
+        return match(first, last, captures, true, state);
+    }
+
+    /**
+     * Same as matchLowercase(const char *, const char *, std::size_t *),
+     * using state as scratch memory.
+     */
+    bool matchLowercase(const char *first, const char *last, std::size_t *captures, State &state) const
+    {
+        return match(first, last, captures, true, state);
+    }
+
+private:
+
+    enum Opcode
+    {
+        OP_CHAR,
+        OP_CHAR_ICASE,
+        OP_CLASS,
+        OP_SPLIT,
+        OP_JMP,
+        OP_SAVE,
+        OP_ASSERT_BEGIN,
+        OP_ASSERT_END,
+        OP_ASSERT_SEGMENT_END,
+        OP_MATCH
+    };
+
+    struct Instruction
+    {
+        unsigned char op;
+        unsigned char c;
+        int x;
+        int y;
+    };
+
+    typedef std::vector<Instruction> Program;
+
+    /**
+     * Step of a natively matched route: a literal followed by an optional
+     * capture of a character run or of one of several literals.
+     */
+    struct Segment
+    {
+        std::string literal;
+        std::size_t group;
+        CharSet set;
+        std::size_t minLength;
+        std::vector<std::string> alternatives;
+    };
+
+    class Compiler;
+    typedef State::ThreadList ThreadList;
+
+    void compileNative(const std::vector<PathToken> &tokens);
+
+    bool match(const char *first, const char *last, std::size_t *captures, bool lowercase, State &state) const;
+
+    bool matchNative(const char *first, const char *last, std::size_t *captures, bool lowercase) const;
+
+    void addThread(ThreadList &list, int pc, const char *first, const char *last,
+                   const char *pos, std::size_t *captures) const;
+
+    Program program_;
+    std::vector<CharSet> classes_;
+    std::vector<Segment> segments_;
+    std::string prefix_;
+    std::size_t groups_;
+    int options_;
+    bool supported_;
+    bool native_;
+    bool endsWithSlash_;
+};
+
+/**
+ * Classify a route by the engine which matches it and estimate the worst
+ * case of a backtracking matcher.
+ *
+ * @param  matcher  route compiled from tokens
+ * @param  regexp   tokensToRegExp(tokens, options).first
+ * @return analysis
+ */
+RouteAnalysis analyzeRoute(const PathMatcher &matcher, const std::string &regexp);
+
+/**
+ * Classify a route, see analyzeRoute(const PathMatcher &, const std::string &).
+ *
+ * @param  tokens
+ * @param  options
+ * @return analysis
+ */
+RouteAnalysis analyzeRoute(const std::vector<PathToken> &tokens, int options = PR_END);
+
+} // namespace HttpUtils
+
+#endif /* PATHMATCHER_HPP_INCLUDED */
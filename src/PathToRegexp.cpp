@@ -5,8 +5,12 @@
  *      Author: Dmitri Rubinstein
  */
 #include "PathToRegexp.hpp"
+#include "UriUtils.hpp"
+#include "PathMatcher.hpp"
 #include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
 #include <iostream>
+#include <cctype>
 
 namespace HttpUtils
 {
@@ -94,45 +98,92 @@ static inline std::string escapeGroup(const std::string &group)
     return res;
 }
 
-static void hexchar(unsigned char c, unsigned char &hex1, unsigned char &hex2)
+/**
+ * Try to represent the pattern as a run of a single character class
+ * followed by `+` or `*` (optionally lazy), e.g. `[^\/]+?` or `\d+`.
+ */
+static bool parseCharRun(const std::string &p, PathValidator::CharSet &set, std::size_t &minLength)
 {
-    hex1 = c / 16;
-    hex2 = c % 16;
-    hex1 += hex1 <= 9 ? '0' : 'A' - 10;
-    hex2 += hex2 <= 9 ? '0' : 'A' - 10;
-}
+    std::size_t pos = 0;
+    if (p.empty())
+        return false;
 
-static std::string encodeURIComponent(const std::string & s)
-{
-    const char *str = s.c_str();
-    std::string v;
-    v.reserve(s.size());
-    for (size_t i = 0, l = s.size(); i < l; i++)
+    const char c = p[pos++];
+    switch (c)
     {
-        const char c = s[i];
-        if ((c >= '0' && c <= '9') ||
-            (c >= 'a' && c <= 'z') ||
-            (c >= 'A' && c <= 'Z') ||
-            c == '-' || c == '_' || c == '.' || c == '!' || c == '~' ||
-            c == '*' || c == '\'' || c == '(' || c == ')')
+        case '[':
+            if (!detail::parseBracket(p, pos, set))
+                return false;
+            break;
+        case '.':
+            set.set();
+            set.reset('\n');
+            set.reset('\r');
+            break;
+        case '\\':
         {
-            v += c;
-        }
-        else if (c == ' ')
-        {
-            v += '+';
+            if (pos == p.size())
+                return false;
+            const char e = p[pos++];
+            char lit;
+            if (!detail::addEscapeToSet(e, set))
+            {
+                if (!detail::escapedChar(e, lit))
+                    return false;
+                set.set(static_cast<unsigned char>(lit));
+            }
+            break;
         }
-        else
+        case '^': case '$': case '*': case '+': case '?':
+        case '(': case ')': case '{': case '}': case ']': case '|':
+            return false;
+        default:
+            set.set(static_cast<unsigned char>(c));
+    }
+
+    if (pos == p.size())
+        return false;
+    if (p[pos] == '+')
+        minLength = 1;
+    else if (p[pos] == '*')
+        minLength = 0;
+    else
+        return false;
+    ++pos;
+
+    if (pos < p.size() && p[pos] == '?')
+        ++pos;
+
+    return pos == p.size();
+}
+
+/**
+ * Try to represent the pattern as an alternation of literals, e.g. `video|audio|text`.
+ */
+static bool parseAlternation(const std::string &p, std::vector<std::string> &alternatives)
+{
+    std::string literal;
+    for (std::size_t pos = 0; pos < p.size(); ++pos)
+    {
+        char c = p[pos];
+        switch (c)
         {
-            v += '%';
-            unsigned char d1, d2;
-            hexchar(c, d1, d2);
-            v += d1;
-            v += d2;
+            case '|':
+                alternatives.push_back(literal);
+                literal.clear();
+                continue;
+            case '\\':
+                if (++pos == p.size() || !detail::escapedChar(p[pos], c))
+                    return false;
+                break;
+            case '^': case '$': case '.': case '*': case '+': case '?':
+            case '(': case ')': case '[': case ']': case '{': case '}':
+                return false;
         }
+        literal += c;
     }
-
-    return v;
+    alternatives.push_back(literal);
+    return true;
 }
 
 static std::string to_string(const std::vector<std::string> &value)
@@ -227,37 +278,91 @@ std::vector<PathToken> parsePath(const std::string &strArg)
     return tokens;
 }
 
-PathFunction::PathFunction(const std::vector<PathToken> &tokens)
+PathValidator::PathValidator(const std::string &pattern)
+    : kind_(PV_REGEX)
+    , pattern_(pattern)
+    , charSet_()
+    , minLength_(0)
+    , alternatives_()
+    , regex_()
+{
+    if (parseCharRun(pattern, charSet_, minLength_))
+    {
+        kind_ = PV_CHAR_RUN;
+    }
+    else if (parseAlternation(pattern, alternatives_))
+    {
+        kind_ = PV_ALTERNATION;
+    }
+    else
+    {
+        alternatives_.clear();
+        regex_.assign("^(?:" + pattern + ")$");
+    }
+}
+
+bool PathValidator::operator()(const char *first, const char *last) const
+{
+    const std::size_t length = last - first;
+    switch (kind_)
+    {
+        case PV_CHAR_RUN:
+            if (length < minLength_)
+                return false;
+            for (; first != last; ++first)
+            {
+                if (!charSet_[static_cast<unsigned char>(*first)])
+                    return false;
+            }
+            return true;
+        case PV_ALTERNATION:
+            for (auto it = alternatives_.begin(), et = alternatives_.end(); it != et; ++it)
+            {
+                if (it->size() == length && std::equal(first, last, it->begin()))
+                    return true;
+            }
+            return false;
+        case PV_REGEX:
+            break;
+    }
+    return std::regex_search(first, last, regex_);
+}
+
+PathFunction::PathFunction(const std::vector<PathToken> &tokens, int options)
     : tokens_(tokens)
     , matches_(tokens.size())
+    , options_(options)
 {
     init();
 }
 
-PathFunction::PathFunction(std::vector<PathToken> &&tokens)
+PathFunction::PathFunction(std::vector<PathToken> &&tokens, int options)
     : tokens_(std::move(tokens))
     , matches_(tokens_.size())
+    , options_(options)
 {
     init();
 }
 
 PathFunction::PathFunction(const PathFunction &other)
     : tokens_(other.tokens_)
-    , matches_()
+    , matches_(other.matches_)
+    , options_(other.options_)
 {
-    copyMatchesFrom(other);
 }
 
 PathFunction::PathFunction(PathFunction &&other)
     : tokens_(std::move(other.tokens_))
     , matches_(std::move(other.matches_))
+    , options_(other.options_)
 {
 }
 
 PathFunction & PathFunction::operator=(const PathFunction &other)
 {
     tokens_ = other.tokens_;
-    copyMatchesFrom(other);
+    matches_ = other.matches_;
+    options_ = other.options_;
     return *this;
 }
 
@@ -265,12 +370,16 @@ PathFunction & PathFunction::operator=(PathFunction &&other)
 {
     tokens_ = std::move(other.tokens_);
     matches_ = std::move(other.matches_);
+    options_ = other.options_;
     return *this;
 }
 
 void PathFunction::init()
 {
-    // Compile all the tokens into regexps.
+    // Trusted input is never validated, so there is nothing to compile.
+    if ((options_ & PF_TRUSTED_INPUT) != 0)
+        return;
+
     // Compile all the patterns before compilation.
     typedef std::vector<PathToken>::size_type size_type;
     const size_type sz = tokens_.size();
@@ -279,25 +388,12 @@ void PathFunction::init()
         const PathToken &token = tokens_[i];
         if (token.which() == 1)
         {
-            matches_[i].reset(new std::regex("^" + boost::get<PathKey>(token).pattern + "$"));
+            matches_[i] = std::make_shared<const PathValidator>(boost::get<PathKey>(token).pattern);
         }
     }
 }
 
-void PathFunction::copyMatchesFrom(const PathFunction &other)
-{
-    matches_.clear();
-    matches_.reserve(other.matches_.size());
-    for (auto it = other.matches_.begin(), et = other.matches_.end(); it != et; ++it)
-    {
-        std::unique_ptr<std::regex> el;
-        if (*it)
-            el.reset(new std::regex(*(*it)));
-        matches_.push_back(std::move(el));
-    }
-}
-
-std::string PathFunction::operator()(const std::map<std::string, std::vector<std::string> > &data)
+std::string PathFunction::operator()(const std::map<std::string, std::vector<std::string> > &data) const
 {
     std::string path;
     typedef std::vector<PathToken>::size_type size_type;
@@ -348,22 +444,22 @@ std::string PathFunction::operator()(const std::map<std::string, std::vector<std
             }
         }
 
-        std::string segment;
         const size_type value_sz = value.size();
 
         for (size_type j = 0; j < value_sz; j++)
         {
-            segment = encodeURIComponent(value[j]);
-            std::smatch res;
+            path += (j == 0 ? key.prefix : key.delimiter);
+
+            // Encode the segment directly into the path and validate it in place.
+            const std::string::size_type pos = path.size();
+            encodeURIComponent(value[j].data(), value[j].data() + value[j].size(), path);
 
-            if (!std::regex_search(segment, res, *matches_[i]))
+            if (matches_[i] && !(*matches_[i])(path.data() + pos, path.data() + path.size()))
             {
                 throw std::logic_error(
-                    "Expected all \"" + key.name + "\" to match \"" + key.pattern + "\", but received \"" + segment
+                    "Expected all \"" + key.name + "\" to match \"" + key.pattern + "\", but received \"" + path.substr(pos)
                         + "\"");
             }
-
-            path += (j == 0 ? key.prefix : key.delimiter) + segment;
         }
     }
 
@@ -17,6 +17,7 @@
 #include <initializer_list>
 #include <memory>
 #include <map>
+#include <bitset>
 #include <boost/variant.hpp>
 
 namespace HttpUtils
@@ -43,28 +44,96 @@ enum PathOptions
     PR_END            = (1<<2)
 };
 
+enum PathFunctionOptions
+{
+    PF_TRUSTED_INPUT  = (1<<0)
+};
+
 typedef std::map<std::string, std::vector<std::string> > SegmentMap;
 
+/**
+ * Immutable predicate checking that a whole string matches a key pattern.
+ *
+ * Simple patterns are compiled into specialised checks instead of a regular
+ * expression: runs of a single character class (`[^\/]+?`, `\d+`,
+ * `[0-9a-f]+`, `.*`) and alternations of literals (`video|audio|text`).
+ * Any other pattern falls back to std::regex.
+ */
+class PathValidator
+{
+public:
+
+    enum Kind
+    {
+        PV_CHAR_RUN,
+        PV_ALTERNATION,
+        PV_REGEX
+    };
+
+    typedef std::bitset<256> CharSet;
+
+    explicit PathValidator(const std::string &pattern);
+
+    Kind kind() const { return kind_; }
+
+    const std::string & pattern() const { return pattern_; }
+
+    /** Characters allowed by a PV_CHAR_RUN validator */
+    const CharSet & charSet() const { return charSet_; }
+
+    /** Minimal length accepted by a PV_CHAR_RUN validator, 0 or 1 */
+    std::size_t minLength() const { return minLength_; }
+
+    /** Literals accepted by a PV_ALTERNATION validator, in pattern order */
+    const std::vector<std::string> & alternatives() const { return alternatives_; }
+
+    bool operator()(const char *first, const char *last) const;
+
+    bool operator()(const std::string &str) const
+    {
+        return (*this)(str.data(), str.data() + str.size());
+    }
+
+private:
+    Kind kind_;
+    std::string pattern_;
+    CharSet charSet_;
+    std::size_t minLength_;
+    std::vector<std::string> alternatives_;
+    std::regex regex_;
+};
+
+/**
+ * Template function for the path, created by compilePath().
+ *
+ * Evaluation is const and thread-safe: the per-key validators are compiled
+ * once, are immutable and shared between copies, so a single PathFunction
+ * (or a global table of them) can be used concurrently from many threads.
+ * Copying is cheap and does not recompile any regular expression.
+ *
+ * With PF_TRUSTED_INPUT the values are only encoded, validation against the
+ * key patterns is skipped entirely.
+ */
 class PathFunction
 {
 public:
 
-    PathFunction(const std::vector<PathToken> &tokens);
-    PathFunction(std::vector<PathToken> &&tokens);
+    PathFunction(const std::vector<PathToken> &tokens, int options = 0);
+    PathFunction(std::vector<PathToken> &&tokens, int options = 0);
     PathFunction(const PathFunction &other);
     PathFunction(PathFunction &&other);
 
     PathFunction & operator=(const PathFunction &other);
     PathFunction & operator=(PathFunction &&other);
 
-    std::string operator()(const SegmentMap &data);
+    std::string operator()(const SegmentMap &data) const;
 
 private:
     std::vector<PathToken> tokens_;
-    std::vector< std::unique_ptr<std::regex> > matches_;
+    std::vector< std::shared_ptr<const PathValidator> > matches_;
+    int options_;
 
     void init();
-    void copyMatchesFrom(const PathFunction &other);
 };
 
 inline std::regex::flag_type pathFlags(int options)
@@ -166,11 +235,12 @@ inline RegExp pathToRegexp(std::initializer_list<const char *> paths, std::vecto
  * Compile a string to a template function for the path.
  *
  * @param  str
+ * @param  options
  * @return
  */
-inline PathFunction compilePath(const std::string &str)
+inline PathFunction compilePath(const std::string &str, int options = 0)
 {
-    return PathFunction(parsePath(str));
+    return PathFunction(parsePath(str), options);
 }
 
 } // namespace HttpUtils
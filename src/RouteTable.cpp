@@ -0,0 +1,98 @@
+/*
+ * RouteTable.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+#include "RouteTable.hpp"
+#include <cstring>
+
+namespace HttpUtils
+{
+
+RouteTable::RouteTable()
+    : slots_()
+    , size_(0)
+{
+}
+
+std::uint64_t RouteTable::hash(const char *first, const char *last)
+{
+    // FNV-1a
+    std::uint64_t h = 14695981039346656037ULL;
+    for (; first != last; ++first)
+    {
+        h ^= static_cast<unsigned char>(*first);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+RouteTable::Slot & RouteTable::probe(std::vector<Slot> &slots, std::uint64_t hash, const std::string &key)
+{
+    const std::size_t mask = slots.size() - 1;
+    for (std::size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        Slot &slot = slots[i];
+        if (slot.routes.empty() || (slot.hash == hash && slot.key == key))
+            return slot;
+    }
+}
+
+void RouteTable::grow()
+{
+    std::vector<Slot> slots(slots_.empty() ? 16 : 2 * slots_.size());
+    for (std::vector<Slot>::iterator it = slots_.begin(), et = slots_.end(); it != et; ++it)
+    {
+        if (!it->routes.empty())
+        {
+            Slot &slot = probe(slots, it->hash, it->key);
+            slot.hash = it->hash;
+            slot.key.swap(it->key);
+            slot.routes.swap(it->routes);
+        }
+    }
+    slots_.swap(slots);
+}
+
+void RouteTable::add(const std::string &key, std::size_t route)
+{
+    const std::uint64_t h = hash(key.data(), key.data() + key.size());
+    if (!slots_.empty())
+    {
+        // Routes of an existing key, e.g. other methods of a path, need no new slot.
+        Slot &slot = probe(slots_, h, key);
+        if (!slot.routes.empty())
+        {
+            slot.routes.push_back(route);
+            return;
+        }
+    }
+
+    if (2 * (size_ + 1) > slots_.size())
+        grow();
+    Slot &slot = probe(slots_, h, key);
+    slot.hash = h;
+    slot.key = key;
+    ++size_;
+    slot.routes.push_back(route);
+}
+
+const std::vector<std::size_t> * RouteTable::find(const char *first, const char *last, std::uint64_t h) const
+{
+    if (size_ == 0)
+        return 0;
+
+    const std::size_t length = last - first;
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = h & mask; ; i = (i + 1) & mask)
+    {
+        const Slot &slot = slots_[i];
+        if (slot.routes.empty())
+            return 0;
+        if (slot.hash == h && slot.key.size() == length && std::memcmp(slot.key.data(), first, length) == 0)
+            return &slot.routes;
+    }
+}
+
+} // namespace HttpUtils
@@ -0,0 +1,112 @@
+/*
+ * RouteTable.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+
+#ifndef ROUTETABLE_HPP_INCLUDED
+#define ROUTETABLE_HPP_INCLUDED
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace HttpUtils
+{
+
+/**
+ * Open addressing hash table from a lowercased path or path segment to
+ * the indices of the routes which may match it. HttpRouter uses it for the
+ * exact paths of routes without parameters and for first path segments.
+ *
+ * The load factor is kept at or below 1/2, so a lookup usually needs a
+ * single probe. Route indices are kept in the order they were added.
+ */
+class RouteTable
+{
+public:
+
+    RouteTable();
+
+    bool empty() const { return size_ == 0; }
+
+    /**
+     * Add a route for key. Routes must be added in increasing index order.
+     *
+     * @param  key    lowercased path or segment
+     * @param  route  index of the route
+     */
+    void add(const std::string &key, std::size_t route);
+
+    /**
+     * Find the routes for a lowercased path or segment.
+     *
+     * @param  first
+     * @param  last
+     * @return indices of the routes in increasing order, or 0 if there are none
+     */
+    const std::vector<std::size_t> * find(const char *first, const char *last) const
+    {
+        return find(first, last, hash(first, last));
+    }
+
+    /**
+     * Same as find(const char *, const char *) with the hash of the key
+     * computed in advance, see prefetch().
+     */
+    const std::vector<std::size_t> * find(const char *first, const char *last, std::uint64_t hash) const;
+
+    /**
+     * Start loading the slot of a key into the cache, so that a later
+     * find() of the key does not wait for memory.
+     *
+     * @param  hash  hash(first, last) of the key
+     */
+    void prefetch(std::uint64_t hash) const
+    {
+#if defined(__GNUC__)
+        if (size_ != 0)
+            __builtin_prefetch(&slots_[hash & (slots_.size() - 1)]);
+#endif
+    }
+
+    /**
+     * Add a route for every key for which pred(key) returns true.
+     *
+     * @param  route  index of the route
+     * @param  pred
+     */
+    template <class Predicate>
+    void addIf(std::size_t route, Predicate pred)
+    {
+        for (typename std::vector<Slot>::iterator it = slots_.begin(), et = slots_.end(); it != et; ++it)
+        {
+            if (!it->routes.empty() && pred(it->key))
+                it->routes.push_back(route);
+        }
+    }
+
+    static std::uint64_t hash(const char *first, const char *last);
+
+private:
+
+    struct Slot
+    {
+        std::uint64_t hash;
+        std::string key;
+        std::vector<std::size_t> routes;
+    };
+
+    Slot & probe(std::vector<Slot> &slots, std::uint64_t hash, const std::string &key);
+
+    void grow();
+
+    std::vector<Slot> slots_;
+    std::size_t size_;
+};
+
+} // namespace HttpUtils
+
+#endif /* ROUTETABLE_HPP_INCLUDED */
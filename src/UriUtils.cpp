@@ -0,0 +1,539 @@
+/*
+ * UriUtils.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+#include "UriUtils.hpp"
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define HTTPUTILS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace HttpUtils
+{
+
+namespace
+{
+
+enum UriCharClass
+{
+    UE = 0, // escape as %XX
+    UC = 1, // copy
+    US = 2  // space, encode as '+'
+};
+
+/**
+ * Classification of every byte for encodeURIComponent.
+ */
+static const unsigned char URI_COMPONENT_CLASS[256] = {
+    /* 0x00 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE,
+    /* 0x10 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE,
+    /* 0x20 */ US, UC, UE, UE, UE, UE, UE, UC, UC, UC, UC, UE, UE, UC, UC, UE,
+    /* 0x30 */ UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UE, UE, UE, UE, UE, UE,
+    /* 0x40 */ UE, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC,
+    /* 0x50 */ UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UE, UE, UE, UE, UC,
+    /* 0x60 */ UE, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC,
+    /* 0x70 */ UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UE, UE, UE, UC, UE,
+    /* 0x80 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE,
+    /* 0x90 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE,
+    /* 0xA0 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE,
+    /* 0xB0 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE,
+    /* 0xC0 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE,
+    /* 0xD0 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE,
+    /* 0xE0 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE,
+    /* 0xF0 */ UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE, UE
+};
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+/** Returns the first character in [first, last) which is not copied unchanged */
+typedef const char * (*ScanFunction)(const char *first, const char *last);
+
+static const char * scanUriSafeScalar(const char *first, const char *last)
+{
+    while (first != last && URI_COMPONENT_CLASS[static_cast<unsigned char>(*first)] == UC)
+        ++first;
+    return first;
+}
+
+#ifdef HTTPUTILS_X86_SIMD
+
+static inline __m128i inRange16(__m128i x, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(x, _mm_set1_epi8(hi + 1)));
+}
+
+/** Sets all bits of every byte of x which is copied unchanged */
+static inline __m128i uriSafe16(__m128i x)
+{
+    const __m128i folded = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    __m128i safe = _mm_or_si128(inRange16(x, '0', '9'), inRange16(folded, 'a', 'z'));
+    safe = _mm_or_si128(safe, inRange16(x, '\'', '*'));
+    safe = _mm_or_si128(safe, inRange16(x, '-', '.'));
+    safe = _mm_or_si128(safe, _mm_cmpeq_epi8(x, _mm_set1_epi8('!')));
+    safe = _mm_or_si128(safe, _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+    return _mm_or_si128(safe, _mm_cmpeq_epi8(x, _mm_set1_epi8('~')));
+}
+
+static const char * scanUriSafeSSE2(const char *first, const char *last)
+{
+    while (last - first >= 16)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        const unsigned mask = ~_mm_movemask_epi8(uriSafe16(x)) & 0xFFFFu;
+        if (mask != 0)
+            return first + __builtin_ctz(mask);
+        first += 16;
+    }
+    return scanUriSafeScalar(first, last);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i inRange32(__m256i x, char lo, char hi)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), x));
+}
+
+__attribute__((target("avx2")))
+static const char * scanUriSafeAVX2(const char *first, const char *last)
+{
+    while (last - first >= 32)
+    {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        const __m256i folded = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+        __m256i safe = _mm256_or_si256(inRange32(x, '0', '9'), inRange32(folded, 'a', 'z'));
+        safe = _mm256_or_si256(safe, inRange32(x, '\'', '*'));
+        safe = _mm256_or_si256(safe, inRange32(x, '-', '.'));
+        safe = _mm256_or_si256(safe, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('!')));
+        safe = _mm256_or_si256(safe, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+        safe = _mm256_or_si256(safe, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('~')));
+        const unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(safe));
+        if (mask != 0)
+            return first + __builtin_ctz(mask);
+        first += 32;
+    }
+    return scanUriSafeSSE2(first, last);
+}
+
+static bool cpuHasAVX2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+}
+
+#endif // HTTPUTILS_X86_SIMD
+
+static ScanFunction selectUriSafeScanner()
+{
+#ifdef HTTPUTILS_X86_SIMD
+    return cpuHasAVX2() ? scanUriSafeAVX2 : scanUriSafeSSE2;
+#else
+    return scanUriSafeScalar;
+#endif
+}
+
+/** Returns the first occurrence of a or b in [first, last), or last */
+typedef const char * (*FindFunction)(const char *first, const char *last, char a, char b);
+
+static const char * findEitherScalar(const char *first, const char *last, char a, char b)
+{
+    while (first != last && *first != a && *first != b)
+        ++first;
+    return first;
+}
+
+#ifdef HTTPUTILS_X86_SIMD
+
+static const char * findEitherSSE2(const char *first, const char *last, char a, char b)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    while (last - first >= 16)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)));
+        if (mask != 0)
+            return first + __builtin_ctz(mask);
+        first += 16;
+    }
+    return findEitherScalar(first, last, a, b);
+}
+
+__attribute__((target("avx2")))
+static const char * findEitherAVX2(const char *first, const char *last, char a, char b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    while (last - first >= 32)
+    {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb))));
+        if (mask != 0)
+            return first + __builtin_ctz(mask);
+        first += 32;
+    }
+    return findEitherSSE2(first, last, a, b);
+}
+
+#endif // HTTPUTILS_X86_SIMD
+
+static FindFunction selectFindEither()
+{
+#ifdef HTTPUTILS_X86_SIMD
+    return cpuHasAVX2() ? findEitherAVX2 : findEitherSSE2;
+#else
+    return findEitherScalar;
+#endif
+}
+
+static inline const char * findEither(const char *first, const char *last, char a, char b)
+{
+    static const FindFunction find = selectFindEither();
+    return find(first, last, a, b);
+}
+
+typedef char * (*LowerFunction)(const char *first, const char *last, char *out);
+
+static char * asciiToLowerScalar(const char *first, const char *last, char *out)
+{
+    for (; first != last; ++first, ++out)
+    {
+        const char c = *first;
+        *out = (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+    return out;
+}
+
+#ifdef HTTPUTILS_X86_SIMD
+
+static char * asciiToLowerSSE2(const char *first, const char *last, char *out)
+{
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    while (last - first >= 16)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        const __m128i upper = inRange16(x, 'A', 'Z');
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_or_si128(x, _mm_and_si128(upper, caseBit)));
+        first += 16;
+        out += 16;
+    }
+    return asciiToLowerScalar(first, last, out);
+}
+
+__attribute__((target("avx2")))
+static char * asciiToLowerAVX2(const char *first, const char *last, char *out)
+{
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    while (last - first >= 32)
+    {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        const __m256i upper = inRange32(x, 'A', 'Z');
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_or_si256(x, _mm256_and_si256(upper, caseBit)));
+        first += 32;
+        out += 32;
+    }
+    return asciiToLowerSSE2(first, last, out);
+}
+
+#endif // HTTPUTILS_X86_SIMD
+
+static LowerFunction selectAsciiToLower()
+{
+#ifdef HTTPUTILS_X86_SIMD
+    return cpuHasAVX2() ? asciiToLowerAVX2 : asciiToLowerSSE2;
+#else
+    return asciiToLowerScalar;
+#endif
+}
+
+/**
+ * Appends the offsets from base of the delimiters in [first, last) to the
+ * count offsets found so far. Returns false when there are more than capacity.
+ */
+typedef bool (*SplitFunction)(const char *base, const char *first, const char *last, char delimiter,
+                              std::uint32_t *offsets, std::size_t &count, std::size_t capacity);
+
+static bool splitScalar(const char *base, const char *first, const char *last, char delimiter,
+                        std::uint32_t *offsets, std::size_t &count, std::size_t capacity)
+{
+    for (; first != last; ++first)
+    {
+        if (*first == delimiter)
+        {
+            if (count == capacity)
+                return false;
+            offsets[count++] = static_cast<std::uint32_t>(first - base);
+        }
+    }
+    return true;
+}
+
+#ifdef HTTPUTILS_X86_SIMD
+
+static bool splitSSE2(const char *base, const char *first, const char *last, char delimiter,
+                      std::uint32_t *offsets, std::size_t &count, std::size_t capacity)
+{
+    const __m128i d = _mm_set1_epi8(delimiter);
+    while (last - first >= 16)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        for (unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, d)); mask != 0; mask &= mask - 1)
+        {
+            if (count == capacity)
+                return false;
+            offsets[count++] = static_cast<std::uint32_t>(first - base + __builtin_ctz(mask));
+        }
+        first += 16;
+    }
+    return splitScalar(base, first, last, delimiter, offsets, count, capacity);
+}
+
+__attribute__((target("avx2")))
+static bool splitAVX2(const char *base, const char *first, const char *last, char delimiter,
+                      std::uint32_t *offsets, std::size_t &count, std::size_t capacity)
+{
+    const __m256i d = _mm256_set1_epi8(delimiter);
+    while (last - first >= 32)
+    {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        for (unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, d)));
+             mask != 0; mask &= mask - 1)
+        {
+            if (count == capacity)
+                return false;
+            offsets[count++] = static_cast<std::uint32_t>(first - base + __builtin_ctz(mask));
+        }
+        first += 32;
+    }
+    return splitSSE2(base, first, last, delimiter, offsets, count, capacity);
+}
+
+#endif // HTTPUTILS_X86_SIMD
+
+static SplitFunction selectSplit()
+{
+#ifdef HTTPUTILS_X86_SIMD
+    return cpuHasAVX2() ? splitAVX2 : splitSSE2;
+#else
+    return splitScalar;
+#endif
+}
+
+/** Unreserved characters of RFC 3986 */
+static inline bool isUnreserved(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+        c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+static inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+} // unnamed namespace
+
+char * encodeURIComponent(const char *first, const char *last, char *out)
+{
+    static const ScanFunction scanUriSafe = selectUriSafeScanner();
+
+    while (first != last)
+    {
+        // Copy the run of characters which need no escaping in bulk.
+        const char *run = scanUriSafe(first, last);
+        std::memcpy(out, first, run - first);
+        out += run - first;
+        first = run;
+
+        // Escape characters until the next run.
+        for (; first != last; ++first)
+        {
+            const unsigned char c = static_cast<unsigned char>(*first);
+            const unsigned char cls = URI_COMPONENT_CLASS[c];
+            if (cls == UC)
+                break;
+            if (cls == US)
+            {
+                *out++ = '+';
+            }
+            else
+            {
+                out[0] = '%';
+                out[1] = HEX_DIGITS[c >> 4];
+                out[2] = HEX_DIGITS[c & 0xF];
+                out += 3;
+            }
+        }
+    }
+    return out;
+}
+
+void encodeURIComponent(const char *first, const char *last, std::string &result)
+{
+    const std::string::size_type pos = result.size();
+    result.resize(pos + 3 * (last - first));
+    char *begin = &result[0];
+    char *end = encodeURIComponent(first, last, begin + pos);
+    result.resize(end - begin);
+}
+
+char * asciiToLower(const char *first, const char *last, char *out)
+{
+    static const LowerFunction lower = selectAsciiToLower();
+    return lower(first, last, out);
+}
+
+void splitPath(const char *first, const char *last, PathSegments &segments, char delimiter)
+{
+    static const SplitFunction split = selectSplit();
+    segments.path_ = first;
+    segments.size_ = last - first;
+    segments.count_ = 0;
+    segments.truncated_ = !split(first, first, last, delimiter, segments.delimiters_,
+                                 segments.count_, PathSegments::MAX_DELIMITERS);
+}
+
+char * normalizePath(const char *first, const char *last, char *out, int options)
+{
+    const bool collapse = (options & NP_COLLAPSE_SLASHES) != 0;
+    const bool resolve = (options & NP_RESOLVE_DOTS) != 0;
+    const bool decode = (options & NP_DECODE_UNRESERVED) != 0;
+
+    // Segments are written to out, each followed by '/' when one follows
+    // in the input. Dot segments are removed again once they are complete.
+    char *const root = out + (first != last && *first == '/');
+    if (root != out)
+        *out++ = *first++;
+
+    for (;;)
+    {
+        char *const segment = out;
+        while (first != last && *first != '/')
+        {
+            if (decode && *first == '%' && last - first >= 3)
+            {
+                const int hi = hexValue(first[1]);
+                const int lo = hi >= 0 ? hexValue(first[2]) : -1;
+                if (lo >= 0 && isUnreserved(static_cast<char>((hi << 4) | lo)))
+                {
+                    *out++ = static_cast<char>((hi << 4) | lo);
+                    first += 3;
+                    continue;
+                }
+            }
+            *out++ = *first++;
+        }
+
+        const bool more = first != last;
+        if (more)
+            ++first;
+
+        const std::size_t length = out - segment;
+        if (resolve && length == 1 && segment[0] == '.')
+        {
+            out = segment;
+        }
+        else if (resolve && length == 2 && segment[0] == '.' && segment[1] == '.')
+        {
+            // Remove the parent segment and its '/'.
+            out = segment;
+            if (out != root)
+            {
+                --out;
+                while (out != root && out[-1] != '/')
+                    --out;
+            }
+        }
+        else if (length != 0 || (more && !collapse))
+        {
+            if (more)
+                *out++ = '/';
+        }
+
+        if (!more)
+            break;
+    }
+
+    if ((options & NP_REMOVE_TRAILING_SLASH) != 0 && out - root > 0 && out[-1] == '/')
+        --out;
+    return out;
+}
+
+const char * findURIEscape(const char *first, const char *last)
+{
+    return findEither(first, last, '%', '+');
+}
+
+char * decodeURIComponent(const char *first, const char *last, char *out)
+{
+    while (first != last)
+    {
+        const char *run = findEither(first, last, '%', '+');
+        std::memmove(out, first, run - first);
+        out += run - first;
+        first = run;
+        if (first == last)
+            break;
+
+        if (*first == '+')
+        {
+            *out++ = ' ';
+            ++first;
+            continue;
+        }
+
+        // Malformed escapes are copied unchanged.
+        const int hi = last - first >= 3 ? hexValue(first[1]) : -1;
+        const int lo = hi >= 0 ? hexValue(first[2]) : -1;
+        if (lo >= 0)
+        {
+            *out++ = static_cast<char>((hi << 4) | lo);
+            first += 3;
+        }
+        else
+        {
+            *out++ = *first++;
+        }
+    }
+    return out;
+}
+
+const char * nextQueryParam(const char *first, const char *last, QueryParam &param)
+{
+    const char *end = findEither(first, last, '&', '&');
+    const char *eq = findEither(first, end, '=', '=');
+    param.key = StringRef(first, eq - first);
+    param.value = eq != end ? StringRef(eq + 1, end - eq - 1) : StringRef(end, 0);
+    return end != last ? end + 1 : end;
+}
+
+std::size_t countQueryParams(const char *first, const char *last)
+{
+    std::size_t count = 1;
+    for (const char *p = findEither(first, last, '&', '&'); p != last; p = findEither(p + 1, last, '&', '&'))
+        ++count;
+    return count;
+}
+
+void decodeURIComponent(const char *first, const char *last, std::string &result)
+{
+    const std::string::size_type pos = result.size();
+    result.resize(pos + (last - first));
+    char *begin = &result[0];
+    char *end = decodeURIComponent(first, last, begin + pos);
+    result.resize(end - begin);
+}
+
+} // namespace HttpUtils
@@ -0,0 +1,276 @@
+/*
+ * UriUtils.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dmitri Rubinstein
+ */
+
+#ifndef URIUTILS_HPP_INCLUDED
+#define URIUTILS_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <boost/utility/string_ref.hpp>
+
+namespace HttpUtils
+{
+
+typedef boost::string_ref StringRef;
+
+/**
+ * Encode a URI component.
+ *
+ * Unreserved characters (alphanumerics and `-_.!~*'()`) are copied, a space
+ * is encoded as `+`, every other byte as `%XX`. Runs of characters that need
+ * no escaping are found with SSE2/AVX2 (selected at runtime) and copied in bulk.
+ *
+ * The output buffer must have room for `3 * (last - first)` characters.
+ *
+ * @param  first
+ * @param  last
+ * @param  out
+ * @return end of the encoded output
+ */
+char * encodeURIComponent(const char *first, const char *last, char *out);
+
+/**
+ * Encode a URI component and append it to result.
+ *
+ * @param  first
+ * @param  last
+ * @param  result
+ */
+void encodeURIComponent(const char *first, const char *last, std::string &result);
+
+/**
+ * Encode a URI component.
+ *
+ * @param  str
+ * @return encoded string
+ */
+inline std::string encodeURIComponent(const std::string &str)
+{
+    std::string result;
+    encodeURIComponent(str.data(), str.data() + str.size(), result);
+    return result;
+}
+
+/**
+ * Convert ASCII letters to lower case, other bytes are copied unchanged.
+ * Uses SSE2/AVX2 (selected at runtime).
+ *
+ * The output buffer must have room for `last - first` characters and may be
+ * the same as the input.
+ *
+ * @param  first
+ * @param  last
+ * @param  out
+ * @return end of the output
+ */
+char * asciiToLower(const char *first, const char *last, char *out);
+
+/**
+ * Find the first character which changes when a URI component is decoded,
+ * i.e. `%` or `+`. Uses SSE2/AVX2 (selected at runtime).
+ *
+ * @param  first
+ * @param  last
+ * @return position of the character or last if there is nothing to decode
+ */
+const char * findURIEscape(const char *first, const char *last);
+
+/**
+ * Decode a URI component encoded by encodeURIComponent().
+ *
+ * `%XX` sequences are decoded, `+` is decoded as a space. Malformed escape
+ * sequences are copied unchanged.
+ *
+ * The output buffer must have room for `last - first` characters and may be
+ * the same as the input.
+ *
+ * @param  first
+ * @param  last
+ * @param  out
+ * @return end of the decoded output
+ */
+char * decodeURIComponent(const char *first, const char *last, char *out);
+
+/**
+ * Decode a URI component and append it to result.
+ *
+ * @param  first
+ * @param  last
+ * @param  result
+ */
+void decodeURIComponent(const char *first, const char *last, std::string &result);
+
+/**
+ * Decode a URI component.
+ *
+ * @param  str
+ * @return decoded string
+ */
+inline std::string decodeURIComponent(const std::string &str)
+{
+    std::string result;
+    decodeURIComponent(str.data(), str.data() + str.size(), result);
+    return result;
+}
+
+/**
+ * Steps of normalizePath().
+ */
+enum NormalizeOptions
+{
+    /** Collapse runs of `/` into a single one */
+    NP_COLLAPSE_SLASHES = 1,
+    /** Remove `.` segments and `..` segments together with their parent */
+    NP_RESOLVE_DOTS = 2,
+    /** Remove a trailing `/` except from the root path, for routes which are not strict */
+    NP_REMOVE_TRAILING_SLASH = 4,
+    /** Decode percent-encoded unreserved characters (alphanumerics and `-._~`) */
+    NP_DECODE_UNRESERVED = 8,
+    NP_ALL = NP_COLLAPSE_SLASHES | NP_RESOLVE_DOTS | NP_REMOVE_TRAILING_SLASH | NP_DECODE_UNRESERVED
+};
+
+/**
+ * Normalize a path in a single pass. Unreserved characters are decoded
+ * before dot segments are resolved, so `%2E%2E` is resolved like `..`, as
+ * in RFC 3986. Other escapes, including `%2F`, are kept.
+ *
+ * Every step only removes characters, so the path changed if and only if
+ * the output is shorter than the input. The output buffer must have room
+ * for `last - first` characters and may be the same as the input.
+ *
+ * @param  first
+ * @param  last
+ * @param  out
+ * @param  options  combination of NormalizeOptions
+ * @return end of the normalized output
+ */
+char * normalizePath(const char *first, const char *last, char *out, int options = NP_ALL);
+
+class PathSegments;
+
+/**
+ * Split a path at every occurrence of delimiter. The delimiter positions
+ * are found with SSE2/AVX2 compare and movemask (selected at runtime) and
+ * stored in segments, nothing is allocated. Splitting `/users/5` at `/`
+ * results in the segments ``, `users` and `5`.
+ *
+ * @param  first
+ * @param  last
+ * @param  segments   receives the delimiter positions, refers to [first, last) afterwards
+ * @param  delimiter
+ */
+void splitPath(const char *first, const char *last, PathSegments &segments, char delimiter = '/');
+
+/**
+ * Segments of a path, see splitPath(). The positions of up to
+ * MAX_DELIMITERS delimiters are kept in a fixed array. When a path has
+ * more delimiters, truncated() is set and the last segment holds the rest
+ * of the path.
+ */
+class PathSegments
+{
+public:
+    static const std::size_t MAX_DELIMITERS = 31;
+
+    PathSegments()
+        : path_(0)
+        , size_(0)
+        , count_(0)
+        , truncated_(false)
+    {
+    }
+
+    /** Number of segments, one more than the number of delimiters */
+    std::size_t size() const { return count_ + 1; }
+
+    bool truncated() const { return truncated_; }
+
+    /** Offset of the i-th delimiter in the path */
+    std::size_t delimiter(std::size_t i) const { return delimiters_[i]; }
+
+    /** Offset of the first character of the i-th segment in the path */
+    std::size_t begin(std::size_t i) const { return i == 0 ? 0 : delimiters_[i - 1] + 1; }
+
+    /** Offset after the last character of the i-th segment in the path */
+    std::size_t end(std::size_t i) const { return i < count_ ? delimiters_[i] : size_; }
+
+    /** The i-th segment as a view into the path */
+    StringRef operator[](std::size_t i) const
+    {
+        return StringRef(path_ + begin(i), end(i) - begin(i));
+    }
+
+private:
+    friend void splitPath(const char *first, const char *last, PathSegments &segments, char delimiter);
+
+    const char *path_;
+    std::size_t size_;
+    std::size_t count_;
+    bool truncated_;
+    std::uint32_t delimiters_[MAX_DELIMITERS];
+};
+
+/**
+ * Raw key/value pair of a query string, both are views into the query string.
+ */
+struct QueryParam
+{
+    StringRef key;
+    StringRef value;
+};
+
+/**
+ * Split the next `key=value` pair off a query string. A pair without `=`
+ * has an empty value.
+ *
+ * @param  first
+ * @param  last
+ * @param  param
+ * @return position after the pair and its `&` separator
+ */
+const char * nextQueryParam(const char *first, const char *last, QueryParam &param);
+
+/**
+ * Upper bound of the number of pairs in a query string, the number of
+ * `&` separators plus one.
+ *
+ * @param  first
+ * @param  last
+ * @return number of pairs including empty ones
+ */
+std::size_t countQueryParams(const char *first, const char *last);
+
+/**
+ * Parse a query string (without the leading `?`) into key/value views
+ * and append them to params. Nothing is decoded, empty pairs are skipped,
+ * repeated keys are kept in order. params is grown at most once.
+ *
+ * @param  first
+ * @param  last
+ * @param  params
+ */
+template <class Allocator>
+void parseQueryString(const char *first, const char *last, std::vector<QueryParam, Allocator> &params)
+{
+    if (first == last)
+        return;
+    params.reserve(params.size() + countQueryParams(first, last));
+
+    QueryParam param;
+    while (first != last)
+    {
+        first = nextQueryParam(first, last, param);
+        if (!param.key.empty() || !param.value.empty())
+            params.push_back(param);
+    }
+}
+
+} // namespace HttpUtils
+
+#endif /* URIUTILS_HPP_INCLUDED */